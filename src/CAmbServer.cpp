@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Local stand-in of the AMB websocket server for test tools
+ * @file    CAmbServer.cpp
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <iostream>
+#include "CAmbServer.h"
+
+CAmbServer *CAmbServer::m_instance = NULL;
+
+static int callback_port0(libwebsocket_context *context,
+                          struct libwebsocket *wsi,
+                          enum libwebsocket_callback_reasons reason,
+                          void *user, void *in, size_t len)
+{
+    return CAmbServer::callback(0, context, wsi, reason, user, in, len);
+}
+
+static int callback_port1(libwebsocket_context *context,
+                          struct libwebsocket *wsi,
+                          enum libwebsocket_callback_reasons reason,
+                          void *user, void *in, size_t len)
+{
+    return CAmbServer::callback(1, context, wsi, reason, user, in, len);
+}
+
+static int callback_port2(libwebsocket_context *context,
+                          struct libwebsocket *wsi,
+                          enum libwebsocket_callback_reasons reason,
+                          void *user, void *in, size_t len)
+{
+    return CAmbServer::callback(2, context, wsi, reason, user, in, len);
+}
+
+static int callback_port3(libwebsocket_context *context,
+                          struct libwebsocket *wsi,
+                          enum libwebsocket_callback_reasons reason,
+                          void *user, void *in, size_t len)
+{
+    return CAmbServer::callback(3, context, wsi, reason, user, in, len);
+}
+
+/**
+ * the protocols carsim connects with, same order as its ProtocolType
+ */
+static libwebsocket_protocols g_ambProtocols[D_AMB_PORTS][2] = {
+    {{"standarddatamessage-only", callback_port0, 0}, {NULL, NULL, 0}},
+    {{"standardcontrolmessage-only", callback_port1, 0}, {NULL, NULL, 0}},
+    {{"customdatamessage-only", callback_port2, 0}, {NULL, NULL, 0}},
+    {{"customcontrolmessage-only", callback_port3, 0}, {NULL, NULL, 0}}
+};
+
+/**
+ * @brief CAmbServer
+ *        Constructor
+ */
+CAmbServer::CAmbServer()
+{
+    m_loop = NULL;
+    m_handler = NULL;
+    m_arg = NULL;
+    m_bCompact = false;
+    for (int i = 0; i < D_AMB_PORTS; i++) {
+        m_context[i] = NULL;
+        m_bConnected[i] = false;
+        m_frames[i] = 0;
+        m_tvBase[i].tv_sec = 0;
+        m_tvBase[i].tv_usec = 0;
+    }
+}
+
+/**
+ * @brief ~CAmbServer
+ *        destructor
+ */
+CAmbServer::~CAmbServer()
+{
+    Stop();
+}
+
+/**
+ * @brief Start
+ *        listen on the ports, the sockets are added to loop
+ * @param port    ports of DefaultInfoPort.DataPort/CtrlPort and
+ *                CustomizeInfoPort.DataPort/CtrlPort
+ * @param loop    event loop serving the sockets
+ * @param handler called for every record, NULL: count frames only
+ * @param arg     argument of handler
+ * @param compact acknowledge name tables(compact format)
+ * @return true:success false:failure
+ */
+bool CAmbServer::Start(const int port[D_AMB_PORTS], CEventLoop *loop,
+                       Handler handler, void *arg, bool compact)
+{
+    if ((NULL != m_instance) || (NULL == loop)) {
+        return false;
+    }
+    m_instance = this;
+    m_loop = loop;
+    m_handler = handler;
+    m_arg = arg;
+    m_bCompact = compact;
+    for (int i = 0; i < D_AMB_PORTS; i++) {
+        m_context[i] =
+            libwebsocket_create_context(port[i], "lo", g_ambProtocols[i],
+                                        libwebsocket_internal_extensions,
+                                        NULL, NULL, -1, -1, 0);
+        if (NULL == m_context[i]) {
+            std::cerr << "Failed to listen on port " << port[i] << "."
+                      << std::endl;
+            Stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Stop
+ *        close all sockets
+ */
+void CAmbServer::Stop()
+{
+    for (int i = 0; i < D_AMB_PORTS; i++) {
+        if (NULL != m_context[i]) {
+            libwebsocket_context_destroy(m_context[i]);
+            m_context[i] = NULL;
+        }
+        m_bConnected[i] = false;
+    }
+    if (this == m_instance) {
+        m_instance = NULL;
+    }
+}
+
+/**
+ * @brief IsAllConnected
+ * @return true:carsim is connected to all ports
+ */
+bool CAmbServer::IsAllConnected() const
+{
+    for (int i = 0; i < D_AMB_PORTS; i++) {
+        if (!m_bConnected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief callback
+ *        protocol callback of all ports
+ */
+int CAmbServer::callback(int port, libwebsocket_context *context,
+                         struct libwebsocket *wsi,
+                         enum libwebsocket_callback_reasons reason,
+                         void *user, void *in, size_t len)
+{
+    CAmbServer *p = m_instance;
+    if (NULL == p) {
+        return 0;
+    }
+    int fd = (int) (long) user;
+    switch (reason) {
+    case LWS_CALLBACK_ESTABLISHED:
+        p->m_bConnected[port] = true;
+        p->m_names[port].clear();
+        p->m_rx[port].clear();
+        break;
+    case LWS_CALLBACK_CLOSED:
+        p->m_bConnected[port] = false;
+        break;
+    case LWS_CALLBACK_RECEIVE:
+        p->receive(port, wsi, reinterpret_cast < const char *>(in),
+                   (int) len);
+        break;
+    case LWS_CALLBACK_ADD_POLL_FD:
+        p->m_loop->Add(fd, (unsigned int) len, CAmbServer::service,
+                       (void *) context);
+        break;
+    case LWS_CALLBACK_DEL_POLL_FD:
+        p->m_loop->Remove(fd);
+        break;
+    case LWS_CALLBACK_SET_MODE_POLL_FD:
+        p->m_loop->Modify(fd, p->m_loop->GetEvents(fd) | (unsigned int) len);
+        break;
+    case LWS_CALLBACK_CLEAR_MODE_POLL_FD:
+        p->m_loop->Modify(fd, p->m_loop->GetEvents(fd) & ~(unsigned int) len);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief service a socket which became ready in the event loop
+ */
+void CAmbServer::service(int fd, unsigned int events, void *arg)
+{
+    CAmbServer *p = m_instance;
+    if (NULL == p) {
+        return;
+    }
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = (short) p->m_loop->GetEvents(fd);
+    pfd.revents = (short) events;
+    libwebsocket_service_fd(reinterpret_cast < libwebsocket_context *>(arg),
+                            &pfd);
+}
+
+/**
+ * @brief receive
+ *        collect the fragments of a frame
+ */
+void CAmbServer::receive(int port, struct libwebsocket *wsi, const char *in,
+                         int len)
+{
+    std::vector<char> &rx = m_rx[port];
+    bool last = ((0 == libwebsockets_remaining_packet_payload(wsi)) &&
+                 libwebsocket_is_final_fragment(wsi));
+    if (rx.empty() && last) {
+        frame(port, wsi, in, len);
+        return;
+    }
+    rx.insert(rx.end(), in, in + len);
+    if (last) {
+        frame(port, wsi, &rx[0], (int) rx.size());
+        rx.clear();
+    }
+}
+
+/**
+ * @brief frame
+ *        one complete websocket frame from carsim
+ */
+void CAmbServer::frame(int port, struct libwebsocket *wsi, const char *data,
+                       int len)
+{
+    struct timespec recv;
+    struct timeval recvtime;
+    clock_gettime(CLOCK_MONOTONIC, &recv);
+    gettimeofday(&recvtime, NULL);
+    m_frames[port]++;
+
+    if (KeyDataIsTable(data, len)) {
+        int pos = 0;
+        int id;
+        const char *name;
+        int namelen;
+        int64_t sec;
+        int64_t usec;
+        memcpy(&sec, &data[8], sizeof(sec));
+        memcpy(&usec, &data[16], sizeof(usec));
+        m_tvBase[port].tv_sec = (time_t) sec;
+        m_tvBase[port].tv_usec = (suseconds_t) usec;
+        m_names[port].clear();
+        while (KeyDataTableNext(data, len, &pos, &id, &name, &namelen)) {
+            if ((int) m_names[port].size() <= id) {
+                m_names[port].resize(id + 1);
+            }
+            m_names[port][id].assign(name, namelen);
+        }
+        if (m_bCompact) {
+            unsigned char ack[LWS_SEND_BUFFER_PRE_PADDING + 4 +
+                              LWS_SEND_BUFFER_POST_PADDING];
+            memcpy(&ack[LWS_SEND_BUFFER_PRE_PADDING], KEYDATA_ACK_MAGIC, 4);
+            libwebsocket_write(wsi, &ack[LWS_SEND_BUFFER_PRE_PADDING], 4,
+                               LWS_WRITE_BINARY);
+        }
+        return;
+    }
+    if (KeyDataIsBatch(data, len)) {
+        int pos = 0;
+        const KeyDataMsg_t *msg;
+        int size;
+        while (KeyDataBatchNext(data, len, &pos, &msg, &size)) {
+            message(port, reinterpret_cast < const char *>(msg), size,
+                    &recv, &recvtime);
+        }
+        return;
+    }
+    message(port, data, len, &recv, &recvtime);
+}
+
+/**
+ * @brief message
+ *        decode one message and call the handler
+ */
+void CAmbServer::message(int port, const char *msg, int size,
+                         const struct timespec *recv,
+                         const struct timeval *recvtime)
+{
+    if (NULL == m_handler) {
+        return;
+    }
+    AmbRecord rec;
+    rec.port = port;
+    rec.vehicle = -1;
+    rec.recv = *recv;
+    rec.recvtime = *recvtime;
+    if (KeyDataIsFleet(msg, size)) {
+        const KeyDataFleetHdr_t *f =
+            reinterpret_cast < const KeyDataFleetHdr_t *>(msg);
+        rec.vehicle = (int) f->vehicle;
+        msg += sizeof(KeyDataFleetHdr_t);
+        size -= sizeof(KeyDataFleetHdr_t);
+    }
+    if (KeyDataIsCompact(msg, size)) {
+        const KeyDataCompact_t *c =
+            reinterpret_cast < const KeyDataCompact_t *>(msg);
+        rec.id = c->id;
+        rec.name = (rec.id < (int) m_names[port].size()) ?
+            m_names[port][rec.id].c_str() : NULL;
+        long usec = (long) m_tvBase[port].tv_usec + (long) c->usec;
+        rec.time.tv_sec = m_tvBase[port].tv_sec + usec / 1000000;
+        rec.time.tv_usec = usec % 1000000;
+        rec.status = &msg[sizeof(KeyDataCompact_t)];
+        rec.size = size - (int) sizeof(KeyDataCompact_t);
+    }
+    else if (size >= (int) sizeof(KeyDataMsg_t)) {
+        const KeyDataMsg_t *m = reinterpret_cast < const KeyDataMsg_t *>(msg);
+        rec.id = -1;
+        rec.name = m->KeyEventType;
+        rec.time = m->recordtime;
+        /* carsim sends sizeof(KeyDataMsg_t) + size of status bytes */
+        rec.status = m->data.status;
+        rec.size = size - (int) sizeof(KeyDataMsg_t);
+    }
+    else {
+        return;
+    }
+    m_handler(&rec, m_arg);
+}
+
+/**
+ * End of File.(CAmbServer.cpp)
+ */
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Local stand-in of the AMB websocket server for test tools
+ *          listens on the four ports of the AMB config with the four
+ *          protocols carsim connects to, decodes single, batched,
+ *          compact and fleet tagged messages and hands every vehicle
+ *          info record to a handler. name tables are acknowledged, so
+ *          carsim can switch to the compact format.
+ *          the sockets are served by a CEventLoop (libwebsockets
+ *          external poll), one instance per process.
+ * @file    CAmbServer.h
+ */
+
+#ifndef CAMBSERVER_H_
+#define CAMBSERVER_H_
+
+#include <time.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include "Websocket.h"
+#include "CEventLoop.h"
+
+#define D_AMB_PORTS     4       // data/ctrl of default/customize
+
+/**
+ * one decoded vehicle info record
+ */
+struct AmbRecord
+{
+    int port;                   // 0 - 3, order of the AMB config ports
+    int vehicle;                // fleet vehicle number, -1: not tagged
+    const char *name;           // NULL: compact id not in the name table
+    int id;                     // compact id, -1: KeyDataMsg_t
+    struct timeval time;        // record time (carsim clock)
+    const char *status;         // KeyDataMsg_t::data.status bytes
+    int size;
+    struct timespec recv;       // CLOCK_MONOTONIC arrival of the frame
+    struct timeval recvtime;    // wall clock arrival of the frame
+};
+
+class CAmbServer
+{
+  public:
+    /**
+     * @brief record handler
+     * @param rec decoded record, valid during the call only
+     * @param arg user argument given to Start()
+     */
+    typedef void (*Handler)(const AmbRecord *rec, void *arg);
+
+            CAmbServer();
+    virtual ~CAmbServer();
+
+    bool    Start(const int port[D_AMB_PORTS], CEventLoop *loop,
+                  Handler handler, void *arg, bool compact);
+    void    Stop();
+
+    bool    IsConnected(int port) const;
+    bool    IsAllConnected() const;
+    unsigned long GetFrameCount(int port) const;
+
+    static int callback(int port, libwebsocket_context *context,
+                        struct libwebsocket *wsi,
+                        enum libwebsocket_callback_reasons reason,
+                        void *user, void *in, size_t len);
+
+  private:
+    static void service(int fd, unsigned int events, void *arg);
+    void    receive(int port, struct libwebsocket *wsi, const char *in,
+                    int len);
+    void    frame(int port, struct libwebsocket *wsi, const char *data,
+                  int len);
+    void    message(int port, const char *msg, int size,
+                    const struct timespec *recv,
+                    const struct timeval *recvtime);
+
+    static CAmbServer *m_instance;
+
+    CEventLoop *m_loop;
+    Handler m_handler;
+    void   *m_arg;
+    bool    m_bCompact;
+    libwebsocket_context *m_context[D_AMB_PORTS];
+    bool    m_bConnected[D_AMB_PORTS];
+    unsigned long m_frames[D_AMB_PORTS];
+    std::vector<char> m_rx[D_AMB_PORTS];        // fragments of a frame
+
+    /* name table of the compact format, per port */
+    std::vector<std::string> m_names[D_AMB_PORTS];
+    struct timeval m_tvBase[D_AMB_PORTS];
+};
+
+/**
+ * @brief IsConnected
+ * @param port 0 - 3
+ * @return true:carsim is connected to the port
+ */
+inline bool CAmbServer::IsConnected(int port) const
+{
+    return m_bConnected[port];
+}
+
+/**
+ * @brief GetFrameCount
+ * @param port 0 - 3
+ * @return websocket frames received on the port
+ */
+inline unsigned long CAmbServer::GetFrameCount(int port) const
+{
+    return m_frames[port];
+}
+
+#endif /* CAMBSERVER_H_ */
+/**
+ * End of File.(CAmbServer.h)
+ */
@@ -18,6 +18,7 @@
 #include <time.h>
 #include <memory.h>
 #include "CAvgCar.h"
+#include "CSimClock.h"
 
 /******************************************
  * average Machine
@@ -513,6 +514,7 @@ CAvgCar::CAvgCar(const short RPMsz, const short SPDsz,
     m_odometer = 0.0;
     m_tp.tv_sec = 0;
     m_tp.tv_nsec = 0;
+    m_clock = NULL;
     m_bChgThrottle = false;
     m_valThrottle = -1;
     m_bChgBrake = false;
@@ -608,7 +610,12 @@ void CAvgCar::calc()
     struct timespec oldtp;
     oldtp.tv_sec = m_tp.tv_sec;
     oldtp.tv_nsec = m_tp.tv_nsec;
-    clock_gettime(CLOCK_MONOTONIC, &m_tp);
+    if (NULL != m_clock) {
+        m_clock->GetTime(&m_tp);
+    }
+    else {
+        clock_gettime(CLOCK_MONOTONIC, &m_tp);
+    }
     if (0.0 != spd) {
         long int sec  = m_tp.tv_sec  - oldtp.tv_sec; // sec
         long int nsec = m_tp.tv_nsec - oldtp.tv_nsec; // nano sec
@@ -626,6 +633,19 @@ void CAvgCar::calc()
         m_currentRunMeter = 0.0l;
     }
 }
+/**
+ * @brief setClock
+ *        time source of the distance integration
+ * @param clock simulation clock, NULL: CLOCK_MONOTONIC
+ */
+void CAvgCar::setClock(const CSimClock *clock)
+{
+    m_clock = clock;
+    if (NULL != m_clock) {
+        m_clock->GetTime(&m_tp);
+    }
+}
+
 /**
  * @brief updateAvg
  */
@@ -364,6 +364,8 @@ inline int CAvgGear::getMode() const
 ******************************************/
 #define D_ACCPEDAL_OPEN 65534
 
+class CSimClock;
+
 class CAvgCar:public CAvgGear
 {
 public:
@@ -390,6 +392,7 @@ public:
     void    tripmeterReset();
 
     void    updateAvg();
+    void    setClock(const CSimClock *clock);
 private:
 
     CAvgBrake m_brake;
@@ -400,6 +403,7 @@ private:
     double  m_tripmeter;
 
     struct timespec m_tp;
+    const CSimClock *m_clock;   // NULL: CLOCK_MONOTONIC
     averageMachine  m_speed;
 
     iAverageMachine m_accPedalOpen;
@@ -141,6 +141,88 @@ POINT CalcDest(double lat, double lng, double azim, double dist)
     return dest;
 }
 
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   radii of curvature of WGS84 ellipsoid
+ *
+ * @param[in]  lat          latitude
+ * @param[out] radii        radii at lat
+ * @return     none
+ */
+/*--------------------------------------------------------------------------*/
+static void CalcRadii(double lat, GEORADII *radii)
+{
+    const double a = 6378137.0;
+    const double f = 1 / 298.257223563;
+    const double e2 = f * (2 - f);
+
+    const double sinLat = sin(lat * (M_PI / 180));
+    const double w2 = 1 - e2 * sinLat * sinLat;
+    const double w = sqrt(w2);
+
+    radii->lat = lat;
+    radii->rN = a / w;
+    radii->rM = a * (1 - e2) / (w2 * w);
+    radii->valid = true;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   calc new point (short step)
+ *
+ * @param[in]  lat          current lat
+ * @param[in]  lon          current lon
+ * @param[in]  azim         current direction
+ * @param[in]  dist         distance
+ * @param[in,out] radii     cache of radii of curvature, NULL:no cache
+ * @return     POINT       new lat and lon
+ */
+/*--------------------------------------------------------------------------*/
+POINT CalcDestFast(double lat, double lng, double azim, double dist,
+                   GEORADII *radii)
+{
+    if ((D_CALC_FAST_MAX_DIST < fabs(dist)) ||
+        (D_CALC_FAST_MAX_LAT < fabs(lat))) {
+        return CalcDest(lat, lng, azim, dist);
+    }
+
+    GEORADII tmp;
+    if (NULL == radii) {
+        radii = &tmp;
+        radii->valid = false;
+    }
+    if ((!radii->valid) || (D_CALC_RADII_STEP < fabs(lat - radii->lat))) {
+        CalcRadii(lat, radii);
+    }
+
+    const double alpha1 = azim * (M_PI / 180);
+    const double north = dist * cos(alpha1);
+    const double east = dist * sin(alpha1);
+
+    /**
+     * second order expansion of the geodesic: the tanLat terms bend the
+     * step from the rhumb line onto the geodesic (meridian convergence)
+     */
+    const double lat1 = lat * (M_PI / 180);
+    const double tanLat = tan(lat1);
+    const double n = north / radii->rM;                 // [rad]
+    const double e = east / (radii->rN * cos(lat1));    // [rad]
+    const double dLat = n - 0.5 * e * e * sin(lat1) * cos(lat1) *
+        (radii->rN / radii->rM);
+    const double dLng = e + e * n * tanLat;
+
+    double lng2 = lng + dLng * (180 / M_PI);
+    while (lng2 >= 180.0)
+        lng2 -= 360.0;
+    while (lng2 < -180.0)
+        lng2 += 360.0;
+
+    POINT dest;
+    dest.lat = lat + dLat * (180 / M_PI);
+    dest.lng = lng2;
+
+    return dest;
+}
 
 /**
  * End of File.(CCalc.cpp)
@@ -25,6 +25,26 @@ typedef struct
     double lng;
 } POINT;
 
+/**
+ * fast geodesy(CalcDestFast) is used up to this distance [m],
+ * longer steps go to CalcDest(Vincenty)
+ */
+#define D_CALC_FAST_MAX_DIST    1000.0
+#define D_CALC_FAST_MAX_LAT     85.0        // near the pole use Vincenty
+#define D_CALC_RADII_STEP       0.001       // [deg] recalc radii beyond this
+
+/**
+ * radii of curvature of the WGS84 ellipsoid at a latitude,
+ * cached by the caller between CalcDestFast() calls
+ */
+typedef struct
+{
+    double lat;                 // latitude of the radii [deg]
+    double rM;                  // meridian radius [m]
+    double rN;                  // prime vertical radius [m]
+    bool valid;
+} GEORADII;
+
 
 /*--------------------------------------------------------------------------*/
 /**
@@ -51,4 +71,71 @@ double CalcAzimuth(double azim, double delta, double dist);
 /*--------------------------------------------------------------------------*/
 POINT CalcDest(double lat, double lng, double azim, double dist);
 
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   calc new point, local tangent plane approximation
+ *          for short steps (|dist| <= D_CALC_FAST_MAX_DIST).
+ *          north/east displacement is converted with the radii of
+ *          curvature plus the second order geodesic terms.
+ *          error against CalcDest (WGS84, |lat| <= D_CALC_FAST_MAX_LAT):
+ *            dist <=   10m : < 1e-5 m (convergence limit of CalcDest)
+ *            dist <=  100m : < 5e-5 m
+ *            dist <= 1000m : < 2e-3 m
+ *          longer steps and |lat| > D_CALC_FAST_MAX_LAT use CalcDest.
+ *
+ * @param[in]  lat          current lat
+ * @param[in]  lon          current lon
+ * @param[in]  azim         current direction
+ * @param[in]  dist         distance
+ * @param[in,out] radii     cache of radii of curvature, NULL:no cache
+ * @return     POINT       new lat and lon
+ */
+/*--------------------------------------------------------------------------*/
+POINT CalcDestFast(double lat, double lng, double azim, double dist,
+                   GEORADII *radii = NULL);
+
+/**
+ * implementation of CalcStepBatch
+ */
+enum CALC_SIMD
+{
+    CALC_SIMD_AUTO = 0,         // best one the CPU supports
+    CALC_SIMD_SCALAR,           // CalcAzimuth + CalcDestFast per vehicle
+    CALC_SIMD_SSE2,             // 2 vehicles at once
+    CALC_SIMD_AVX2              // 4 vehicles at once
+};
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   advance many vehicles by one step (structure of arrays)
+ *          for every i:
+ *            azim[i] = CalcAzimuth(azim[i], steer[i], dist[i])
+ *            lat[i], lng[i] = CalcDestFast(lat[i], lng[i], azim[i], dist[i])
+ *          SIMD results differ from the scalar functions only by rounding
+ *          (< 1e-9 deg), vehicles with long steps or near the pole take
+ *          the scalar path.
+ *
+ * @param[in]     n         number of vehicles
+ * @param[in,out] lat       lat
+ * @param[in,out] lng       lon
+ * @param[in,out] azim      direction
+ * @param[in]     dist      distance of this step
+ * @param[in]     steer     steering angle
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CalcStepBatch(int n, double lat[], double lng[], double azim[],
+                   const double dist[], const double steer[]);
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   select implementation of CalcStepBatch
+ *
+ * @param[in]  simd         CALC_SIMD_xxx
+ * @return     CALC_SIMD    implementation in use (unsupported one is
+ *                          replaced by the best supported one)
+ */
+/*--------------------------------------------------------------------------*/
+CALC_SIMD CalcSetSimd(CALC_SIMD simd);
+
 #endif // CCALC_H
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Computation tool, many vehicles at once
+ *          scalar and SSE2 implementation, dispatcher
+ *
+ * @file    CCalcBatch.cpp
+ */
+#include <math.h>
+#include <stdio.h>
+#include "CCalc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define D_CALC_X86
+#endif
+
+#if defined(D_CALC_X86) && defined(__SSE2__)
+#include <emmintrin.h>
+#include "CCalcVec.h"
+
+/**
+ * vector traits, 2 doubles in __m128d
+ */
+struct CalcVecSSE2
+{
+    typedef __m128d V;
+    enum { N = 2 };
+
+    static V set1(double d) { return _mm_set1_pd(d); }
+    static V load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, V a) { _mm_storeu_pd(p, a); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm_div_pd(a, b); }
+    static V sqrt(V a) { return _mm_sqrt_pd(a); }
+    static V abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    /* |a| < 2^31 */
+    static V trunc(V a) { return _mm_cvtepi32_pd(_mm_cvttpd_epi32(a)); }
+    static V eq(V a, V b) { return _mm_cmpeq_pd(a, b); }
+    static V lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+    static V gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+    static V andv(V a, V b) { return _mm_and_pd(a, b); }
+    static V orv(V a, V b) { return _mm_or_pd(a, b); }
+    static V xorv(V a, V b) { return _mm_xor_pd(a, b); }
+    static V select(V m, V a, V b)
+    {
+        return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));
+    }
+    static int mask(V m) { return _mm_movemask_pd(m); }
+};
+#define D_CALC_HAVE_SSE2
+#endif
+
+#ifdef D_CALC_X86
+/* CCalcBatchAVX2.cpp */
+int CalcStepAVX2(int n, double lat[], double lng[], double azim[],
+                 const double dist[], const double steer[]);
+#endif
+
+static CALC_SIMD g_calcSimd = CALC_SIMD_AUTO;
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   select implementation of CalcStepBatch
+ *
+ * @param[in]  simd         CALC_SIMD_xxx
+ * @return     CALC_SIMD    implementation in use
+ */
+/*--------------------------------------------------------------------------*/
+CALC_SIMD CalcSetSimd(CALC_SIMD simd)
+{
+    CALC_SIMD best = CALC_SIMD_SCALAR;
+#ifdef D_CALC_HAVE_SSE2
+    best = CALC_SIMD_SSE2;
+#endif
+#ifdef D_CALC_X86
+    if (__builtin_cpu_supports("avx2")) {
+        best = CALC_SIMD_AVX2;
+    }
+#endif
+    if ((CALC_SIMD_AUTO == simd) || (best < simd)) {
+        simd = best;
+    }
+    g_calcSimd = simd;
+    return g_calcSimd;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   advance many vehicles by one step
+ *
+ * @param[in]     n         number of vehicles
+ * @param[in,out] lat       lat
+ * @param[in,out] lng       lon
+ * @param[in,out] azim      direction
+ * @param[in]     dist      distance of this step
+ * @param[in]     steer     steering angle
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CalcStepBatch(int n, double lat[], double lng[], double azim[],
+                   const double dist[], const double steer[])
+{
+    if (CALC_SIMD_AUTO == g_calcSimd) {
+        CalcSetSimd(CALC_SIMD_AUTO);
+    }
+
+    int i = 0;
+    switch (g_calcSimd) {
+#ifdef D_CALC_X86
+    case CALC_SIMD_AVX2:
+        i = CalcStepAVX2(n, lat, lng, azim, dist, steer);
+        break;
+#endif
+#ifdef D_CALC_HAVE_SSE2
+    case CALC_SIMD_SSE2:
+        i = CalcVecStep < CalcVecSSE2 > (n, lat, lng, azim, dist, steer);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    /* scalar path and the rest of the vector path */
+    for (; i < n; i++) {
+        azim[i] = CalcAzimuth(azim[i], steer[i], dist[i]);
+        POINT p = CalcDestFast(lat[i], lng[i], azim[i], dist[i]);
+        lat[i] = p.lat;
+        lng[i] = p.lng;
+    }
+}
+
+/**
+ * End of File.(CCalcBatch.cpp)
+ */
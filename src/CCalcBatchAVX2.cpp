@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Computation tool, many vehicles at once
+ *          AVX2 implementation, only called if the CPU supports it
+ *
+ * @file    CCalcBatchAVX2.cpp
+ */
+#include <math.h>
+#include <stdio.h>
+#include "CCalc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/**
+ * everything below is compiled for AVX2, system headers are included
+ * above so that none of their inline functions is built with AVX2
+ */
+#pragma GCC target("avx2")
+
+#include "CCalcVec.h"
+
+/**
+ * vector traits, 4 doubles in __m256d
+ */
+struct CalcVecAVX2
+{
+    typedef __m256d V;
+    enum { N = 4 };
+
+    static V set1(double d) { return _mm256_set1_pd(d); }
+    static V load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, V a) { _mm256_storeu_pd(p, a); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm256_div_pd(a, b); }
+    static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+    static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static V trunc(V a)
+    {
+        return _mm256_round_pd(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    }
+    static V eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static V lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static V gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static V andv(V a, V b) { return _mm256_and_pd(a, b); }
+    static V orv(V a, V b) { return _mm256_or_pd(a, b); }
+    static V xorv(V a, V b) { return _mm256_xor_pd(a, b); }
+    static V select(V m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+    static int mask(V m) { return _mm256_movemask_pd(m); }
+};
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   CalcStepBatch, 4 vehicles at once
+ *
+ * @return  int     number of vehicles processed
+ */
+/*--------------------------------------------------------------------------*/
+int CalcStepAVX2(int n, double lat[], double lng[], double azim[],
+                 const double dist[], const double steer[])
+{
+    return CalcVecStep < CalcVecAVX2 > (n, lat, lng, azim, dist, steer);
+}
+#endif
+
+/**
+ * End of File.(CCalcBatchAVX2.cpp)
+ */
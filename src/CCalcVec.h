@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   SIMD kernel of CalcStepBatch
+ *          written once against a vector traits class T:
+ *            T::V           vector of T::N doubles
+ *            T::set1/load/store
+ *            T::add/sub/mul/div/sqrt/abs/trunc
+ *            T::eq/lt/gt    all bits set where true
+ *            T::select(m, a, b)  m ? a : b
+ *            T::andv/orv/xorv, T::mask(m) bit i set if lane i is true
+ *          only included by the files that define a traits class, each of
+ *          them compiled for its own instruction set.
+ *
+ * @file    CCalcVec.h
+ */
+#ifndef CCALCVEC_H
+#define CCALCVEC_H
+
+#include "CCalc.h"
+
+/**
+ * sin and cos of x [rad], range reduction and polynomials of cephes
+ * (error < 1 ulp for |x| < 2^30)
+ */
+template < class T >
+inline void CalcVecSinCos(typename T::V x, typename T::V * s,
+                          typename T::V * c)
+{
+    typedef typename T::V V;
+    const V zero = T::set1(0.0);
+    const V one = T::set1(1.0);
+
+    V sign = T::lt(x, zero);
+    V ax = T::abs(x);
+
+    /* octant, rounded up to even */
+    V y = T::trunc(T::mul(ax, T::set1(4.0 / M_PI)));
+    V odd = T::sub(y, T::mul(T::trunc(T::mul(y, T::set1(0.5))),
+                             T::set1(2.0)));
+    y = T::add(y, odd);
+    V j = T::sub(y, T::mul(T::trunc(T::mul(y, T::set1(0.125))),
+                           T::set1(8.0)));
+
+    V z = T::sub(ax, T::mul(y, T::set1(7.85398125648498535156E-1)));
+    z = T::sub(z, T::mul(y, T::set1(3.77489470793079817668E-8)));
+    z = T::sub(z, T::mul(y, T::set1(2.69515142907905952645E-15)));
+    V zz = T::mul(z, z);
+
+    V ps = T::set1(1.58962301576546568060E-10);
+    ps = T::add(T::mul(ps, zz), T::set1(-2.50507477628578072866E-8));
+    ps = T::add(T::mul(ps, zz), T::set1(2.75573136213857245213E-6));
+    ps = T::add(T::mul(ps, zz), T::set1(-1.98412698295895385996E-4));
+    ps = T::add(T::mul(ps, zz), T::set1(8.33333333332211858878E-3));
+    ps = T::add(T::mul(ps, zz), T::set1(-1.66666666666666307295E-1));
+    ps = T::add(z, T::mul(T::mul(z, zz), ps));
+
+    V pc = T::set1(-1.13585365213876817300E-11);
+    pc = T::add(T::mul(pc, zz), T::set1(2.08757008419747316778E-9));
+    pc = T::add(T::mul(pc, zz), T::set1(-2.75573141792967388112E-7));
+    pc = T::add(T::mul(pc, zz), T::set1(2.48015872888517045348E-5));
+    pc = T::add(T::mul(pc, zz), T::set1(-1.38888888888730564116E-3));
+    pc = T::add(T::mul(pc, zz), T::set1(4.16666666666665929218E-2));
+    pc = T::add(T::sub(one, T::mul(zz, T::set1(0.5))),
+                T::mul(T::mul(zz, zz), pc));
+
+    /**
+     * octant  sin  cos
+     *   0     +ps  +pc
+     *   2     +pc  -ps
+     *   4     -ps  -pc
+     *   6     -pc  +ps
+     */
+    V j2 = T::eq(j, T::set1(2.0));
+    V j4 = T::eq(j, T::set1(4.0));
+    V j6 = T::eq(j, T::set1(6.0));
+    V swap = T::orv(j2, j6);
+    V vs = T::select(swap, pc, ps);
+    V vc = T::select(swap, ps, pc);
+    V negS = T::xorv(T::orv(j4, j6), sign);
+    V negC = T::orv(j2, j4);
+    *s = T::select(negS, T::sub(zero, vs), vs);
+    *c = T::select(negC, T::sub(zero, vc), vc);
+}
+
+/**
+ * vectorized CalcAzimuth + CalcDestFast
+ * @return number of vehicles processed, the rest (< T::N) is left to the
+ *         caller
+ */
+template < class T >
+int CalcVecStep(int n, double lat[], double lng[], double azim[],
+                const double dist[], const double steer[])
+{
+    typedef typename T::V V;
+    const double a = 6378137.0;
+    const double f = 1 / 298.257223563;
+    const double e2 = f * (2 - f);
+    const V zero = T::set1(0.0);
+    const V one = T::set1(1.0);
+    const V v360 = T::set1(360.0);
+    const V d2r = T::set1(M_PI / 180);
+    const V r2d = T::set1(180 / M_PI);
+
+    int i = 0;
+    for (; i + T::N <= n; i += T::N) {
+        V vLat = T::load(&lat[i]);
+        V vLng = T::load(&lng[i]);
+        V vAzim = T::load(&azim[i]);
+        V vDist = T::load(&dist[i]);
+        V vSteer = T::load(&steer[i]);
+
+        /**
+         * CalcAzimuth
+         * theta = dist / Rs [deg], Rs = WHEEL_BASE / |sin(steer)|,
+         * reduced by whole turns like the loop of CalcAzimuth
+         */
+        V sSteer, cSteer;
+        CalcVecSinCos < T > (T::mul(vSteer, d2r), &sSteer, &cSteer);
+        V theta = T::div(T::mul(T::mul(vDist, T::abs(sSteer)), r2d),
+                         T::set1(WHEEL_BASE));
+        V at = T::abs(theta);
+        V turns = T::trunc(T::div(at, v360));
+        at = T::sub(at, T::mul(turns, v360));
+        theta = T::select(T::lt(theta, zero), T::sub(zero, at), at);
+        theta = T::select(T::lt(vSteer, zero), T::sub(zero, theta), theta);
+        vAzim = T::add(vAzim, theta);
+        vAzim = T::select(T::lt(vAzim, zero), T::add(vAzim, v360), vAzim);
+        vAzim = T::select(T::gt(vAzim, v360), T::sub(vAzim, v360), vAzim);
+
+        /**
+         * CalcDestFast
+         */
+        V sLat, cLat;
+        CalcVecSinCos < T > (T::mul(vLat, d2r), &sLat, &cLat);
+        V w2 = T::sub(one, T::mul(T::set1(e2), T::mul(sLat, sLat)));
+        V w = T::sqrt(w2);
+        V rN = T::div(T::set1(a), w);
+        V rM = T::div(T::set1(a * (1 - e2)), T::mul(w2, w));
+
+        V sA, cA;
+        CalcVecSinCos < T > (T::mul(vAzim, d2r), &sA, &cA);
+        V vn = T::div(T::mul(vDist, cA), rM);
+        V ve = T::div(T::mul(vDist, sA), T::mul(rN, cLat));
+        V dLat = T::sub(vn, T::mul(T::mul(T::set1(0.5), T::mul(ve, ve)),
+                                   T::mul(T::mul(sLat, cLat),
+                                          T::div(rN, rM))));
+        V dLng = T::add(ve, T::mul(T::mul(ve, vn), T::div(sLat, cLat)));
+
+        V lat2 = T::add(vLat, T::mul(dLat, r2d));
+        V lng2 = T::add(vLng, T::mul(dLng, r2d));
+        lng2 = T::select(T::lt(lng2, T::set1(180.0)), lng2,
+                         T::sub(lng2, v360));
+        lng2 = T::select(T::lt(lng2, T::set1(-180.0)), T::add(lng2, v360),
+                         lng2);
+
+        T::store(&azim[i], vAzim);
+
+        /* long steps and polar latitudes go to the scalar path */
+        V slow = T::orv(T::gt(T::abs(vDist), T::set1(D_CALC_FAST_MAX_DIST)),
+                        T::gt(T::abs(vLat), T::set1(D_CALC_FAST_MAX_LAT)));
+        int m = T::mask(slow);
+        if (0 == m) {
+            T::store(&lat[i], lat2);
+            T::store(&lng[i], lng2);
+            continue;
+        }
+        double tLat[T::N];
+        double tLng[T::N];
+        T::store(tLat, lat2);
+        T::store(tLng, lng2);
+        for (int k = 0; k < T::N; k++) {
+            if (m & (1 << k)) {
+                POINT p = CalcDestFast(lat[i + k], lng[i + k], azim[i + k],
+                                       dist[i + k]);
+                tLat[k] = p.lat;
+                tLng[k] = p.lng;
+            }
+            lat[i + k] = tLat[k];
+            lng[i + k] = tLng[k];
+        }
+    }
+    return i;
+}
+
+#endif // CCALCVEC_H
+/**
+ * End of File.(CCalcVec.h)
+ */
@@ -12,6 +12,12 @@
  *
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <vector>
 #include "CConf.h"
 
 CConf::CConf()
@@ -31,6 +37,7 @@ void CConf::LoadConfig()
 
     strncat(m_strConfPath, "/CarSim_Daemon.conf", sizeof(m_strConfPath));
     printf("ConfPath:%s\n", m_strConfPath);
+    CConf::Load(m_strConfPath);
 
     m_nWinkR = CConf::GetConfig(m_strConfPath, "WINKER_RIGHT", "NUMBER", 4);
     m_nWinkL = CConf::GetConfig(m_strConfPath, "WINKER_LEFT", "NUMBER", 5);
@@ -46,6 +53,31 @@ void CConf::LoadConfig()
     m_fLng =
         CConf::GetConfig(m_strConfPath, "LASTPOSITION", "LNG", 139.736518);
 
+    m_nTickHz = CConf::GetConfig(m_strConfPath, "RUNLOOP", "TICK_HZ", 100);
+    m_nIntervalHz =
+        CConf::GetConfig(m_strConfPath, "RUNLOOP", "INTERVAL_HZ", 20);
+    if (0 >= m_nTickHz) {
+        printf("RUNLOOP TICK_HZ=%d is invalid, using 100\n", m_nTickHz);
+        m_nTickHz = 100;
+    }
+    if ((0 >= m_nIntervalHz) || (m_nTickHz < m_nIntervalHz)) {
+        int hz = (m_nTickHz < 20) ? m_nTickHz : 20;
+        printf("RUNLOOP INTERVAL_HZ=%d is invalid for TICK_HZ=%d, "
+               "using %d\n", m_nIntervalHz, m_nTickHz, hz);
+        m_nIntervalHz = hz;
+    }
+    else if (0 != (m_nTickHz % m_nIntervalHz)) {
+        printf("RUNLOOP INTERVAL_HZ=%d is not a divisor of TICK_HZ=%d, "
+               "sending at %.2fHz\n", m_nIntervalHz, m_nTickHz,
+               (double) m_nTickHz / (double) (m_nTickHz / m_nIntervalHz));
+    }
+
+    m_nBatch = CConf::GetConfig(m_strConfPath, "WEBSOCKET", "BATCH", 0);
+    m_nCompact = CConf::GetConfig(m_strConfPath, "WEBSOCKET", "COMPACT", 0);
+    m_nConnectTimeout =
+        CConf::GetConfig(m_strConfPath, "WEBSOCKET", "CONNECT_TIMEOUT", 5000);
+
+    m_nFastGeodesy = CConf::GetConfig(m_strConfPath, "GEODESY", "FAST", 0);
 
     printf("Configuration:\n");
     printf("  WINKER(R) button:%d\tWINKER(L) button:%d\n", m_nWinkR,
@@ -53,123 +85,352 @@ void CConf::LoadConfig()
     printf("  SHIFT(U) button:%d\tSHIFT(D) button:%d\n", m_nShiftU,
            m_nShiftD);
     printf("  STEERING axis:%d\tACCEL axis:%d\n", m_nSteering, m_nAccel);
+    printf("  TICK rate:%dHz\tINTERVAL rate:%dHz\n", m_nTickHz,
+           m_nIntervalHz);
+    printf("  WEBSOCKET batch:%d\tcompact:%d\tconnect timeout:%dms\n",
+           m_nBatch, m_nCompact, m_nConnectTimeout);
+    printf("  GEODESY fast:%d\n", m_nFastGeodesy);
 }
 
-bool CConf::GetConfig(const char *strPath, const char *strSection,
-                      const char *strKey, const char *strDefault, char *buf,
-                      int bufsize)
+/**
+ * parsed value of a key, converted once
+ */
+struct ConfValue
 {
-    char *line = NULL;
-    size_t len = 0;
-    std::string key = "";
-    std::string sec = "";
+    std::string str;
+    int n;
+    double f;
+};
 
-    char retbuf[STR_BUF_SIZE];
-    memset(retbuf, 0, sizeof(retbuf));
+/**
+ * @brief FNV-1a hash of len bytes, continued from h
+ */
+static unsigned int ConfHash(unsigned int h, const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
-    if (strDefault == NULL) {
-        strncpy(buf, "" "", bufsize);
-        return false;
+static const unsigned int confHashInit = 2166136261u;
+
+/**
+ * @brief hash of a section and key, a trailing '=' of the key is not
+ *        part of it
+ */
+static unsigned int ConfKeyHash(const char *sec, size_t seclen,
+                                const char *key, size_t keylen)
+{
+    unsigned int h = ConfHash(confHashInit, sec, seclen);
+    h = ConfHash(h, "]", 1);
+    return ConfHash(h, key, keylen);
+}
+
+/**
+ * section and key -> value of one file, the first entry of a key wins.
+ * a chained hash table, lookups take the section and key as they are
+ * passed in and allocate nothing
+ */
+class ConfStore
+{
+  public:
+    ConfStore() : head(16, -1) {}
+
+    /**
+     * @brief value of a key
+     * @param keylen length of key without a trailing '='
+     * @return value, NULL if not found
+     */
+    const ConfValue *find(const char *sec, const char *key,
+                          size_t keylen) const
+    {
+        size_t seclen = strlen(sec);
+        unsigned int h = ConfKeyHash(sec, seclen, key, keylen);
+        for (int i = head[h & (head.size() - 1)]; i >= 0;
+             i = entries[i].next) {
+            const Entry &e = entries[i];
+            if ((e.hash == h) && (e.sec.length() == seclen) &&
+                (e.key.length() == keylen) &&
+                (memcmp(e.sec.data(), sec, seclen) == 0) &&
+                (memcmp(e.key.data(), key, keylen) == 0)) {
+                return &e.value;
+            }
+        }
+        return NULL;
     }
-    if ((strSection == NULL) || (strKey == NULL)) {
-        strncpy(buf, strDefault, bufsize);
-        return false;
+
+    /**
+     * @brief add a key, a key added before is kept
+     * @return value to fill in, NULL if the key exists
+     */
+    ConfValue *add(const std::string &sec, const std::string &key)
+    {
+        if (find(sec.c_str(), key.data(), key.length()) != NULL) {
+            return NULL;
+        }
+        if (entries.size() >= head.size() / 2) {
+            rehash(head.size() * 2);
+        }
+        Entry e;
+        e.sec = sec;
+        e.key = key;
+        e.hash = ConfKeyHash(sec.data(), sec.length(),
+                             key.data(), key.length());
+        size_t b = e.hash & (head.size() - 1);
+        e.next = head[b];
+        head[b] = (int) entries.size();
+        entries.push_back(e);
+        return &entries.back().value;
     }
 
-    FILE *fp = fopen(strPath, "r");
-    if (fp == NULL) {
-        strncpy(buf, strDefault, bufsize);
-        return false;
+  private:
+    struct Entry
+    {
+        std::string sec;
+        std::string key;
+        unsigned int hash;
+        int next;
+        ConfValue value;
+    };
+
+    void rehash(size_t n)
+    {
+        head.assign(n, -1);
+        for (size_t i = 0; i < entries.size(); i++) {
+            size_t b = entries[i].hash & (n - 1);
+            entries[i].next = head[b];
+            head[b] = (int) i;
+        }
     }
 
-    key = strKey;
-    if (key.rfind("=", key.length()) != key.length() - 1) {
-        key += "=";
+    std::vector<int> head;      /* bucket -> first entry, size 2^n */
+    std::vector<Entry> entries;
+};
+
+/**
+ * store of a file path, a file not found has an empty store
+ */
+struct ConfFile
+{
+    std::string path;
+    unsigned int hash;
+    ConfStore *store;
+};
+
+/**
+ * loaded files, a process reads one or two so they are scanned.
+ * Load() swaps a file's store under the write lock, lookups hold the
+ * read lock while they copy a value out
+ */
+static std::vector<ConfFile> g_confFiles;
+static pthread_rwlock_t g_confLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * @brief store of a file, the read or write lock is held
+ * @return store, NULL if the file was never loaded
+ */
+static ConfFile *FindConfFile(const char *strPath)
+{
+    size_t len = strlen(strPath);
+    unsigned int h = ConfHash(confHashInit, strPath, len);
+    for (size_t i = 0; i < g_confFiles.size(); i++) {
+        ConfFile &f = g_confFiles[i];
+        if ((f.hash == h) && (f.path.length() == len) &&
+            (memcmp(f.path.data(), strPath, len) == 0)) {
+            return &f;
+        }
     }
+    return NULL;
+}
 
-    while (true) {
-        int n = getline(&line, &len, fp);
+/**
+ * @brief read a whole file with a single read
+ * @param strPath file
+ * @param data contents
+ * @return true:success false:failure
+ */
+static bool ReadConfFile(const char *strPath, std::string &data)
+{
+    int fd = open(strPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    data.resize((size_t) st.st_size);
+    size_t len = 0;
+    while (len < data.size()) {
+        ssize_t n = read(fd, &data[len], data.size() - len);
         if (n < 0) {
-            strncpy(buf, strDefault, bufsize);
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
             return false;
         }
+        if (n == 0) {
+            break;
+        }
+        len += (size_t) n;
+    }
+    data.resize(len);
+    close(fd);
+    return true;
+}
 
-        std::string s = line;
+/**
+ * @brief parse the contents of a configuration file
+ * @param data contents
+ * @param store parsed keys
+ */
+static void ParseConf(const std::string &data, ConfStore &store)
+{
+    std::string sec = "";
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos) {
+            end = data.size();
+        }
+        std::string s = data.substr(pos, end - pos);
+        pos = end + 1;
 
         if (s.find("//", 0) == 0) {
             // skip comment
             continue;
         }
 
-        if ((s.find("[", 0) == 0)
-            && (s.rfind("]", s.length()) == s.length() - 2)) {
-            s = s.erase(0, 1);
-            sec = s.erase(s.rfind("]"), s.length() - s.rfind("]"));
+        if ((s.find("[", 0) == 0) && (s.length() >= 2) &&
+            (s.rfind("]") == s.length() - 1)) {
+            sec = s.substr(1, s.length() - 2);
             continue;
         }
 
-        if ((s.find(key, 0) == 0) && (sec == strSection)) {
-            s.erase(0, key.length());
-            s.erase(s.length() - 1, 2);
-
-            ::memcpy(retbuf, s.c_str(), s.length());
-            strncpy(buf, retbuf, bufsize);
-            break;
+        size_t eq = s.find('=');
+        if ((eq == std::string::npos) || (eq == 0)) {
+            continue;
         }
+        ConfValue *v = store.add(sec, s.substr(0, eq));
+        if (v == NULL) {
+            continue;
+        }
+        v->str = s.substr(eq + 1, STR_BUF_SIZE - 1);
+        v->n = atoi(v->str.c_str());
+        v->f = atof(v->str.c_str());
     }
-
-
-    if (fp)
-        fclose(fp);
-    return true;
 }
 
-int CConf::GetConfig(const char *strPath, const char *strSection,
-                     const char *strKey, int nDefault)
+/**
+ * @brief Load
+ *        read and parse a configuration file into a new store and swap
+ *        it in, a file loaded before is replaced (reload). safe while
+ *        other threads call GetConfig()
+ * @param strPath configuration file
+ * @return true:success false:file not readable, lookups get defaults
+ */
+bool CConf::Load(const char *strPath)
 {
-    int nRet = nDefault;
+    if (strPath == NULL) {
+        return false;
+    }
+    ConfStore *store = new ConfStore();
+    std::string data;
+    bool ret = ReadConfFile(strPath, data);
+    if (ret) {
+        ParseConf(data, *store);
+    }
 
-    if (strPath == NULL)
-        return nRet;
-    if (strSection == NULL)
-        return nRet;
-    if (strKey == NULL)
-        return nRet;
+    pthread_rwlock_wrlock(&g_confLock);
+    ConfFile *file = FindConfFile(strPath);
+    if (file == NULL) {
+        ConfFile f;
+        f.path = strPath;
+        f.hash = ConfHash(confHashInit, strPath, strlen(strPath));
+        f.store = NULL;
+        g_confFiles.push_back(f);
+        file = &g_confFiles.back();
+    }
+    ConfStore *old = file->store;
+    file->store = store;
+    pthread_rwlock_unlock(&g_confLock);
 
-    char buf[STR_BUF_SIZE];
+    delete old;
+    return ret;
+}
 
-    memset(buf, 0, sizeof(buf));
-    bool b =
-        CConf::GetConfig(strPath, strSection, strKey, "", buf, sizeof(buf));
+/**
+ * @brief value of a key, the file is loaded on its first lookup.
+ *        returns with the read lock held, the caller copies the value
+ *        out and unlocks
+ * @return value, NULL if not found
+ */
+static const ConfValue *FindConfig(const char *strPath,
+                                   const char *strSection,
+                                   const char *strKey)
+{
+    pthread_rwlock_rdlock(&g_confLock);
+    ConfFile *file = FindConfFile(strPath);
+    if (file == NULL) {
+        pthread_rwlock_unlock(&g_confLock);
+        CConf::Load(strPath);
+        pthread_rwlock_rdlock(&g_confLock);
+        file = FindConfFile(strPath);
+    }
 
-    if (!b)
-        return nRet;
+    size_t keylen = strlen(strKey);
+    if ((keylen > 0) && (strKey[keylen - 1] == '=')) {
+        keylen--;
+    }
+    return file->store->find(strSection, strKey, keylen);
+}
+
+bool CConf::GetConfig(const char *strPath, const char *strSection,
+                      const char *strKey, const char *strDefault, char *buf,
+                      int bufsize)
+{
+    if (strDefault == NULL) {
+        strncpy(buf, "" "", bufsize);
+        return false;
+    }
+    if ((strPath == NULL) || (strSection == NULL) || (strKey == NULL)) {
+        strncpy(buf, strDefault, bufsize);
+        return false;
+    }
 
-    return atoi((char *) buf);
+    const ConfValue *v = FindConfig(strPath, strSection, strKey);
+    bool ret = (v != NULL);
+    strncpy(buf, ret ? v->str.c_str() : strDefault, bufsize);
+    pthread_rwlock_unlock(&g_confLock);
+    return ret;
+}
 
+int CConf::GetConfig(const char *strPath, const char *strSection,
+                     const char *strKey, int nDefault)
+{
+    if ((strPath == NULL) || (strSection == NULL) || (strKey == NULL)) {
+        return nDefault;
+    }
+    const ConfValue *v = FindConfig(strPath, strSection, strKey);
+    int n = (v != NULL) ? v->n : nDefault;
+    pthread_rwlock_unlock(&g_confLock);
+    return n;
 }
 
 double CConf::GetConfig(const char *strPath, const char *strSection,
                         const char *strKey, double fDefault)
 {
-    double fRet = fDefault;
-
-    if (strPath == NULL)
-        return fRet;
-    if (strSection == NULL)
-        return fRet;
-    if (strKey == NULL)
-        return fRet;
-
-    char buf[STR_BUF_SIZE];
-
-    bool b =
-        CConf::GetConfig(strPath, strSection, strKey, "", buf, sizeof(buf));
-
-    if (!b)
-        return fRet;
-
-    return atof((char *) buf);
+    if ((strPath == NULL) || (strSection == NULL) || (strKey == NULL)) {
+        return fDefault;
+    }
+    const ConfValue *v = FindConfig(strPath, strSection, strKey);
+    double f = (v != NULL) ? v->f : fDefault;
+    pthread_rwlock_unlock(&g_confLock);
+    return f;
 }
 
 void CConf::GetModulePath(char *buf, int bufsize)
@@ -8,6 +8,9 @@
  */
 /**
  * @brief   Read configuration file
+ *          a file is read and parsed once into an in-memory hashed store,
+ *          GetConfig() serves from the store without allocating, Load()
+ *          parses it again and swaps the store in while lookups run
  * @file    CConf.h
  */
 
@@ -45,6 +48,8 @@ class CConf
     static bool SetConfig(const char *strPath, const char *strSection,
                           const char *strKey, const char strValue);
 
+    static bool Load(const char *strPath);
+
     static void GetModulePath(char *buf, int bufsize);
 
     void LoadConfig();
@@ -63,6 +68,15 @@ class CConf
     double m_fLng;
     double m_fLat;
 
+    int m_nTickHz;
+    int m_nIntervalHz;
+
+    int m_nBatch;
+    int m_nCompact;
+    int m_nConnectTimeout;
+
+    int m_nFastGeodesy;
+
 };
 
 #endif /* CCONF_H_ */
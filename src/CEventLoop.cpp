@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   epoll based event loop
+ * @file    CEventLoop.cpp
+ */
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <iostream>
+#include "CEventLoop.h"
+
+#define D_EVENTLOOP_MAX_EVENTS 16
+
+/**
+ * @brief convert poll(2) event bits to epoll(7) event bits
+ */
+static unsigned int toEpoll(unsigned int events)
+{
+    unsigned int r = 0;
+    if (events & POLLIN)  r |= EPOLLIN;
+    if (events & POLLPRI) r |= EPOLLPRI;
+    if (events & POLLOUT) r |= EPOLLOUT;
+    return r;
+}
+
+/**
+ * @brief convert epoll(7) event bits to poll(2) event bits
+ */
+static unsigned int toPoll(unsigned int events)
+{
+    unsigned int r = 0;
+    if (events & EPOLLIN)  r |= POLLIN;
+    if (events & EPOLLPRI) r |= POLLPRI;
+    if (events & EPOLLOUT) r |= POLLOUT;
+    if (events & EPOLLERR) r |= POLLERR;
+    if (events & EPOLLHUP) r |= POLLHUP;
+    return r;
+}
+
+/**
+ * @brief CEventLoop
+ *        Constructor
+ */
+CEventLoop::CEventLoop()
+{
+    m_epfd = -1;
+}
+
+/**
+ * @brief ~CEventLoop
+ *        destructor
+ */
+CEventLoop::~CEventLoop()
+{
+    Close();
+}
+
+/**
+ * @brief Open
+ *        create epoll instance
+ * @return true:success false:failure
+ */
+bool CEventLoop::Open()
+{
+    if (isOpen()) {
+        return true;
+    }
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (0 > m_epfd) {
+        std::cerr << "Failed to create epoll(" << errno << ")." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Close
+ *        release epoll instance and all registrations
+ */
+void CEventLoop::Close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    close(m_epfd);
+    m_epfd = -1;
+    m_handlers.clear();
+}
+
+/**
+ * @brief Add
+ *        watch file descriptor
+ * @param fd     file descriptor
+ * @param events POLLIN / POLLOUT
+ * @param cb     called when event occurred
+ * @param arg    argument of cb
+ * @return true:success false:failure
+ */
+bool CEventLoop::Add(int fd, unsigned int events, Callback cb, void *arg)
+{
+    if ((!isOpen()) || (0 > fd) || (NULL == cb)) {
+        return false;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (0 > epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev)) {
+        if ((EEXIST != errno) ||
+            (0 > epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev))) {
+            std::cerr << "Failed to add fd(" << fd << ") to epoll("
+                      << errno << ")." << std::endl;
+            return false;
+        }
+    }
+    Handler h;
+    h.events = events;
+    h.cb = cb;
+    h.arg = arg;
+    m_handlers[fd] = h;
+    return true;
+}
+
+/**
+ * @brief Modify
+ *        change watching events
+ * @param fd     file descriptor
+ * @param events POLLIN / POLLOUT
+ * @return true:success false:failure
+ */
+bool CEventLoop::Modify(int fd, unsigned int events)
+{
+    std::map<int, Handler>::iterator it = m_handlers.find(fd);
+    if (it == m_handlers.end()) {
+        return false;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (0 > epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev)) {
+        return false;
+    }
+    it->second.events = events;
+    return true;
+}
+
+/**
+ * @brief Remove
+ *        stop watching file descriptor
+ * @param fd file descriptor
+ * @return true:success false:failure
+ */
+bool CEventLoop::Remove(int fd)
+{
+    std::map<int, Handler>::iterator it = m_handlers.find(fd);
+    if (it == m_handlers.end()) {
+        return false;
+    }
+    m_handlers.erase(it);
+    /* fd may already be closed, the kernel dropped it in that case */
+    epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
+    return true;
+}
+
+/**
+ * @brief GetEvents
+ * @param fd file descriptor
+ * @return watching events, 0 if not registered
+ */
+unsigned int CEventLoop::GetEvents(int fd) const
+{
+    std::map<int, Handler>::const_iterator it = m_handlers.find(fd);
+    if (it == m_handlers.end()) {
+        return 0;
+    }
+    return it->second.events;
+}
+
+/**
+ * @brief Dispatch
+ *        wait for events once and call their callbacks
+ * @param timeout milli sec, -1:infinite
+ * @return number of dispatched events, 0:timeout or interrupted by signal,
+ *         negative value:error
+ */
+int CEventLoop::Dispatch(int timeout)
+{
+    if (!isOpen()) {
+        return -1;
+    }
+    struct epoll_event evs[D_EVENTLOOP_MAX_EVENTS];
+    int n = epoll_wait(m_epfd, evs, D_EVENTLOOP_MAX_EVENTS, timeout);
+    if (0 > n) {
+        if (EINTR == errno) {
+            return 0;
+        }
+        std::cerr << "Failed to epoll_wait(" << errno << ")." << std::endl;
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        /* a previous callback may have removed this fd */
+        std::map<int, Handler>::iterator it = m_handlers.find(evs[i].data.fd);
+        if (it == m_handlers.end()) {
+            continue;
+        }
+        Handler h = it->second;
+        h.cb(evs[i].data.fd, toPoll(evs[i].events), h.arg);
+    }
+    return n;
+}
+
+/**
+ * End of File.(CEventLoop.cpp)
+ */
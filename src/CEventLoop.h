@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   epoll based event loop
+ *          one thread waits for joystick input, websocket sockets and
+ *          the tick timer at the same time
+ * @file    CEventLoop.h
+ */
+
+#ifndef CEVENTLOOP_H_
+#define CEVENTLOOP_H_
+
+#include <poll.h>
+#include <map>
+
+class CEventLoop
+{
+  public:
+    /**
+     * @brief event callback
+     * @param fd     file descriptor
+     * @param events occurred events(POLLIN, POLLOUT, POLLERR, POLLHUP)
+     * @param arg    user argument given to Add()
+     */
+    typedef void (*Callback)(int fd, unsigned int events, void *arg);
+
+            CEventLoop();
+    virtual ~CEventLoop();
+
+    bool    Open();
+    void    Close();
+    bool    isOpen() const;
+
+    bool    Add(int fd, unsigned int events, Callback cb, void *arg);
+    bool    Modify(int fd, unsigned int events);
+    bool    Remove(int fd);
+    unsigned int GetEvents(int fd) const;
+
+    int     Dispatch(int timeout);
+
+  private:
+    struct Handler
+    {
+        unsigned int events;
+        Callback cb;
+        void *arg;
+    };
+
+    int     m_epfd;
+    std::map<int, Handler> m_handlers;
+};
+
+/**
+ * @brief isOpen
+ * @return true:epoll instance exists
+ */
+inline bool CEventLoop::isOpen() const
+{
+    return (0 <= m_epfd);
+}
+
+#endif /* CEVENTLOOP_H_ */
+/**
+ * End of File.(CEventLoop.h)
+ */
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   many simulated vehicles for load tests
+ * @file    CFleet.cpp
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include "CFleet.h"
+#include "CCalc.h"
+#include "CAvgCar.h"
+
+#define D_FLEET_MAX_SPEED       199.0   // [km/h]
+#define D_FLEET_ACCEL           3.0     // [m/s^2] full throttle
+#define D_FLEET_DECEL           8.0     // [m/s^2] full brake
+#define D_FLEET_DRAG            0.0004  // [1/m] aero drag
+#define D_FLEET_ROLL            0.1     // [m/s^2] rolling resistance
+#define D_FLEET_RPM_PER_KMH     30.0
+#define D_FLEET_SPREAD          5.0     // [m] start position spread
+#define D_FLEET_SCRIPT_SHIFT    0.5     // [sec] script shift per vehicle
+
+/**
+ * @brief CFleet
+ *        Constructor
+ */
+CFleet::CFleet()
+{
+    m_size = 0;
+    m_time = 0.0;
+    m_dt = 0.0;
+    m_gen = 0;
+    m_pending = 0;
+    m_bQuit = false;
+    m_bOpen = false;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_condStart, NULL);
+    pthread_cond_init(&m_condDone, NULL);
+}
+
+/**
+ * @brief ~CFleet
+ *        destructor
+ */
+CFleet::~CFleet()
+{
+    Close();
+    pthread_cond_destroy(&m_condDone);
+    pthread_cond_destroy(&m_condStart);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+/**
+ * @brief Open
+ *        create vehicles and worker threads
+ * @param vehicles number of vehicles
+ * @param threads  number of threads including the caller of Step()
+ * @param lat      start position
+ * @param lng      start position
+ * @param seed     seed of random inputs
+ * @return true:success false:failure
+ */
+bool CFleet::Open(int vehicles, int threads, double lat, double lng,
+                  unsigned int seed)
+{
+    if ((0 >= vehicles) || (0 >= threads) ||
+        (D_FLEET_MAX_THREADS < threads)) {
+        return false;
+    }
+    Close();
+    if (threads > vehicles) {
+        threads = vehicles;
+    }
+
+    m_size = vehicles;
+    m_time = 0.0;
+    m_throttle.assign(vehicles, 0.0);
+    m_brake.assign(vehicles, 0.0);
+    m_steer.assign(vehicles, 0.0);
+    m_hold.assign(vehicles, 0.0);
+    m_rand.resize(vehicles);
+    m_speed.assign(vehicles, 0.0);
+    m_rpm.assign(vehicles, D_IDLING_RPM * 100.0);
+    m_dist.assign(vehicles, 0.0);
+    m_lat.resize(vehicles);
+    m_lng.resize(vehicles);
+    m_azim.resize(vehicles);
+
+    for (int i = 0; i < vehicles; i++) {
+        /* every vehicle gets its own sequence */
+        unsigned int r = seed ^ ((unsigned int) i * 2654435761U);
+        m_rand[i] = (0 == r) ? 1 : r;
+        /* in a row to the south, headings spread over 360 deg */
+        POINT p = CalcDestFast(lat, lng, 180.0, D_FLEET_SPREAD * i);
+        m_lat[i] = p.lat;
+        m_lng[i] = p.lng;
+        m_azim[i] = fmod(360.0 * i / vehicles, 360.0);
+    }
+
+    /**
+     * contiguous ranges, multiples of 4 so that every thread but the
+     * last one runs full SIMD vectors
+     */
+    int chunk = (vehicles + threads - 1) / threads;
+    chunk = (chunk + 3) & ~3;
+    m_workers.clear();
+    for (int t = 0, b = 0; (t < threads) && (b < vehicles); t++) {
+        Worker w;
+        w.fleet = this;
+        w.begin = b;
+        w.end = (b + chunk < vehicles) ? b + chunk : vehicles;
+        w.gen = m_gen;
+        m_workers.push_back(w);
+        b = w.end;
+    }
+
+    m_bQuit = false;
+    m_bOpen = true;
+    for (size_t t = 1; t < m_workers.size(); t++) {
+        if (0 != pthread_create(&m_workers[t].thread, NULL, CFleet::worker,
+                                &m_workers[t])) {
+            std::cerr << "Failed to create fleet thread." << std::endl;
+            m_workers.resize(t);
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief LoadScript
+ *        use scripted inputs instead of random ones
+ * @param path script file
+ * @return true:success false:failure
+ */
+bool CFleet::LoadScript(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (NULL == fp) {
+        printf("Fleet script open error: %s\n", path);
+        return false;
+    }
+    std::vector<FleetScriptPoint> script;
+    char line[256];
+    while (NULL != fgets(line, sizeof(line), fp)) {
+        char *c = strchr(line, '#');
+        if (NULL != c) {
+            *c = '\0';
+        }
+        FleetScriptPoint p;
+        if (4 != sscanf(line, "%lf %lf %lf %lf", &p.time, &p.throttle,
+                        &p.brake, &p.steer)) {
+            continue;
+        }
+        if ((!script.empty()) && (p.time <= script.back().time)) {
+            printf("Fleet script: time must increase(%f)\n", p.time);
+            fclose(fp);
+            return false;
+        }
+        script.push_back(p);
+    }
+    fclose(fp);
+    if (script.size() < 2) {
+        printf("Fleet script: at least 2 points needed\n");
+        return false;
+    }
+    m_script = script;
+    return true;
+}
+
+/**
+ * @brief Close
+ *        stop worker threads
+ */
+void CFleet::Close()
+{
+    if (!m_bOpen) {
+        return;
+    }
+    pthread_mutex_lock(&m_mutex);
+    m_bQuit = true;
+    pthread_cond_broadcast(&m_condStart);
+    pthread_mutex_unlock(&m_mutex);
+    for (size_t t = 1; t < m_workers.size(); t++) {
+        pthread_join(m_workers[t].thread, NULL);
+    }
+    m_workers.clear();
+    m_bOpen = false;
+}
+
+/**
+ * @brief Step
+ *        advance all vehicles by one tick
+ * @param dt tick length [sec]
+ */
+void CFleet::Step(double dt)
+{
+    if (!m_bOpen) {
+        return;
+    }
+    /* the mutex orders m_dt and the state between the threads */
+    pthread_mutex_lock(&m_mutex);
+    m_dt = dt;
+    m_gen++;
+    m_pending = (int) m_workers.size() - 1;
+    pthread_cond_broadcast(&m_condStart);
+    pthread_mutex_unlock(&m_mutex);
+
+    stepRange(m_workers[0].begin, m_workers[0].end);
+
+    pthread_mutex_lock(&m_mutex);
+    while (0 < m_pending) {
+        pthread_cond_wait(&m_condDone, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    m_time += dt;
+}
+
+/**
+ * @brief worker
+ *        thread body, steps its range on every tick
+ */
+void *CFleet::worker(void *arg)
+{
+    Worker *w = reinterpret_cast < Worker * >(arg);
+    CFleet *f = w->fleet;
+    pthread_mutex_lock(&f->m_mutex);
+    while (true) {
+        while ((w->gen == f->m_gen) && (!f->m_bQuit)) {
+            pthread_cond_wait(&f->m_condStart, &f->m_mutex);
+        }
+        if (f->m_bQuit) {
+            break;
+        }
+        w->gen = f->m_gen;
+        pthread_mutex_unlock(&f->m_mutex);
+
+        f->stepRange(w->begin, w->end);
+
+        pthread_mutex_lock(&f->m_mutex);
+        if (0 == --f->m_pending) {
+            pthread_cond_signal(&f->m_condDone);
+        }
+    }
+    pthread_mutex_unlock(&f->m_mutex);
+    return NULL;
+}
+
+/**
+ * @brief updateInput
+ *        throttle / brake / steer of one vehicle at the current time
+ */
+void CFleet::updateInput(int i)
+{
+    if (!m_script.empty()) {
+        const double period = m_script.back().time - m_script[0].time;
+        double t = m_time + D_FLEET_SCRIPT_SHIFT * i;
+        t = m_script[0].time + fmod(t, period);
+        size_t k = 1;
+        while ((k + 1 < m_script.size()) && (m_script[k].time < t)) {
+            k++;
+        }
+        const FleetScriptPoint &p0 = m_script[k - 1];
+        const FleetScriptPoint &p1 = m_script[k];
+        double r = (t - p0.time) / (p1.time - p0.time);
+        m_throttle[i] = p0.throttle + (p1.throttle - p0.throttle) * r;
+        m_brake[i] = p0.brake + (p1.brake - p0.brake) * r;
+        m_steer[i] = p0.steer + (p1.steer - p0.steer) * r;
+        return;
+    }
+
+    m_hold[i] -= m_dt;
+    if (0.0 < m_hold[i]) {
+        return;
+    }
+    /* xorshift32, deterministic for a seed */
+    unsigned int r = m_rand[i];
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    m_rand[i] = r;
+    double u0 = (double) (r & 0xffff) / 65535.0;
+    double u1 = (double) ((r >> 16) & 0xffff) / 65535.0;
+    if (0.2 > u0) {
+        m_throttle[i] = 0.0;
+        m_brake[i] = u1;
+    }
+    else {
+        m_throttle[i] = u1;
+        m_brake[i] = 0.0;
+    }
+    m_steer[i] = (u0 - 0.5) * 60.0;
+    m_hold[i] = 1.0 + 4.0 * u1;
+}
+
+/**
+ * @brief stepRange
+ *        advance vehicles [begin, end)
+ */
+void CFleet::stepRange(int begin, int end)
+{
+    const double dt = m_dt;
+    for (int i = begin; i < end; i++) {
+        updateInput(i);
+        double v = m_speed[i] / 3.6;    // [m/s]
+        double a = D_FLEET_ACCEL * m_throttle[i] -
+            D_FLEET_DECEL * m_brake[i];
+        if (0.0 < v) {
+            a -= D_FLEET_ROLL + D_FLEET_DRAG * v * v;
+        }
+        double v2 = v + a * dt;
+        if (0.0 > v2) {
+            v2 = 0.0;
+        }
+        if (D_FLEET_MAX_SPEED / 3.6 < v2) {
+            v2 = D_FLEET_MAX_SPEED / 3.6;
+        }
+        m_dist[i] = (v + v2) * 0.5 * dt;
+        m_speed[i] = v2 * 3.6;
+        m_rpm[i] = D_IDLING_RPM * 100.0 + m_speed[i] * D_FLEET_RPM_PER_KMH;
+    }
+    int n = end - begin;
+    CalcStepBatch(n, &m_lat[begin], &m_lng[begin], &m_azim[begin],
+                  &m_dist[begin], &m_steer[begin]);
+}
+
+/**
+ * End of File.(CFleet.cpp)
+ */
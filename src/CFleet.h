@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   many simulated vehicles for load tests
+ *          vehicle state is kept as structure of arrays, all vehicles
+ *          step on a shared tick, split over a pool of threads.
+ *          inputs come from a script (same script for every vehicle,
+ *          shifted in time) or from a seeded random walk.
+ * @file    CFleet.h
+ */
+
+#ifndef CFLEET_H_
+#define CFLEET_H_
+
+#include <pthread.h>
+#include <vector>
+
+#define D_FLEET_MAX_THREADS     64
+
+/**
+ * one point of the input script
+ *   text file, one point per line: time[sec] throttle brake steer
+ *   throttle/brake 0.0 - 1.0, steer[deg], '#' starts a comment.
+ *   inputs are interpolated linearly, the script repeats at its end.
+ */
+struct FleetScriptPoint
+{
+    double time;
+    double throttle;
+    double brake;
+    double steer;
+};
+
+class CFleet
+{
+  public:
+            CFleet();
+    virtual ~CFleet();
+
+    bool    Open(int vehicles, int threads, double lat, double lng,
+                 unsigned int seed);
+    bool    LoadScript(const char *path);
+    void    Close();
+
+    void    Step(double dt);
+
+    int     GetSize() const;
+    int     GetThreads() const;
+    double  GetTime() const;
+
+    /* state of all vehicles, index = vehicle id */
+    const double *GetSpeed() const;     // [km/h]
+    const double *GetRPM() const;
+    const double *GetLat() const;
+    const double *GetLng() const;
+    const double *GetAzimuth() const;   // [deg]
+
+  private:
+    static void *worker(void *arg);
+    void    stepRange(int begin, int end);
+    void    updateInput(int i);
+
+    int     m_size;
+    double  m_time;
+    double  m_dt;
+
+    /* input */
+    std::vector<double> m_throttle;
+    std::vector<double> m_brake;
+    std::vector<double> m_steer;
+    std::vector<double> m_hold;         // random: time until next input
+    std::vector<unsigned int> m_rand;   // random: xorshift state
+    std::vector<FleetScriptPoint> m_script;
+
+    /* state */
+    std::vector<double> m_speed;
+    std::vector<double> m_rpm;
+    std::vector<double> m_dist;
+    std::vector<double> m_lat;
+    std::vector<double> m_lng;
+    std::vector<double> m_azim;
+
+    /* thread pool, thread 0 is the caller of Step() */
+    struct Worker
+    {
+        CFleet *fleet;
+        int begin;
+        int end;
+        unsigned long gen;      // last generation stepped
+        pthread_t thread;
+    };
+    std::vector<Worker> m_workers;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_condStart;
+    pthread_cond_t m_condDone;
+    unsigned long m_gen;        // incremented by Step()
+    int     m_pending;          // workers still stepping
+    bool    m_bQuit;
+    bool    m_bOpen;
+};
+
+/**
+ * @brief GetSize
+ * @return number of vehicles
+ */
+inline int CFleet::GetSize() const
+{
+    return m_size;
+}
+
+/**
+ * @brief GetThreads
+ * @return number of threads stepping the vehicles
+ */
+inline int CFleet::GetThreads() const
+{
+    return (int) m_workers.size();
+}
+
+/**
+ * @brief GetTime
+ * @return simulated time since Open() [sec]
+ */
+inline double CFleet::GetTime() const
+{
+    return m_time;
+}
+
+inline const double *CFleet::GetSpeed() const
+{
+    return &m_speed[0];
+}
+
+inline const double *CFleet::GetRPM() const
+{
+    return &m_rpm[0];
+}
+
+inline const double *CFleet::GetLat() const
+{
+    return &m_lat[0];
+}
+
+inline const double *CFleet::GetLng() const
+{
+    return &m_lng[0];
+}
+
+inline const double *CFleet::GetAzimuth() const
+{
+    return &m_azim[0];
+}
+
+#endif /* CFLEET_H_ */
+/**
+ * End of File.(CFleet.h)
+ */
@@ -14,6 +14,7 @@
  * @file    CGtCtrl.cpp
  */
 #include <unistd.h>
+#include <stddef.h>
 #include "CJoyStick.h"
 #include "CJoyStickEV.h"
 #include "CGtCtrl.h"
@@ -26,21 +27,40 @@ bool g_bStopFlag;
 std::queue < geoData > routeList;
 std::string msgQueue;
 int Daemon_MS;
-pthread_mutex_t m_websocket_mutex[] = {
-    PTHREAD_MUTEX_INITIALIZER,
-    PTHREAD_MUTEX_INITIALIZER,
-    PTHREAD_MUTEX_INITIALIZER,
-    PTHREAD_MUTEX_INITIALIZER
+WebsocketRecvQueue m_websocket_queue[4];
+
+/**
+ * names of VehicleInfoKey
+ */
+static const char *g_viKeyName[VI_KEY_MAX] = {
+    "LOCATION",
+    "STEERING",
+    "TURN_SIGNAL",
+    "ENGINE_SPEED",
+    "ACCPEDAL_OPEN",
+    "BRAKE_SIGNAL",
+    "BRAKE_PRESSURE",
+    "VELOCITY",
+    "SHIFT",
+    "DIRECTION"
 };
 
-pthread_cond_t m_websocket_cond[] = {
-    PTHREAD_COND_INITIALIZER,
-    PTHREAD_COND_INITIALIZER,
-    PTHREAD_COND_INITIALIZER,
-    PTHREAD_COND_INITIALIZER
+/**
+ * send priority used when the AMB config has none
+ */
+static const long g_viKeyPriority[VI_KEY_MAX] = {
+    4,                          // LOCATION
+    2,                          // STEERING
+    1,                          // TURN_SIGNAL
+    3,                          // ENGINE_SPEED
+    4,                          // ACCPEDAL_OPEN
+    1,                          // BRAKE_SIGNAL
+    2,                          // BRAKE_PRESSURE
+    2,                          // VELOCITY
+    1,                          // SHIFT
+    3                           // DIRECTION
 };
 
-WebsocketRecvQueue m_websocket_queue[4];
 int nClient = 0;
 int nDelayedCallback = 0;
 
@@ -88,22 +108,13 @@ static int callback_ctrl_cust(libwebsocket_context *context,
                               struct libwebsocket *wsi,
                               enum libwebsocket_callback_reasons reason,
                               void *user, void *in, size_t len);
+/**
+ * all four connections share one context, same order as ProtocolType
+ */
 libwebsocket_protocols protocols[] = {
     {"standarddatamessage-only", callback_data_def, 0},
-    {NULL, NULL, -1}
-};
-
-libwebsocket_protocols protocols2[] = {
     {"standardcontrolmessage-only", callback_ctrl_def, 0},
-    {NULL, NULL, -1}
-};
-
-libwebsocket_protocols protocols3[] = {
     {"customdatamessage-only", callback_data_cust, 0},
-    {NULL, NULL, -1}
-};
-
-libwebsocket_protocols protocols4[] = {
     {"customcontrolmessage-only", callback_ctrl_cust, 0},
     {NULL, NULL, -1}
 };
@@ -120,6 +131,23 @@ CGtCtrl::CGtCtrl()
     signal(SIGCHLD, CGtCtrl::signal_handler);
 
     m_bUseGps = false;
+    m_bBatch = false;
+    m_bCompact = false;
+    m_bFastGeodesy = false;
+    m_geoRadii.valid = false;
+    m_nFleetSize = 0;
+    m_nFleetThreads = 0;
+    m_bHeadless = false;
+    m_dSimDuration = 0.0;
+    m_nTickNsec = 0;
+    m_dReplaySpeed = 1.0;
+    m_jsInput.trace = NULL;
+    m_bFirstVelocity = false;
+    for (int i = 0; i < 4; i++) {
+        m_bCompactAck[i] = false;
+        m_bConnUp[i] = false;
+        m_nRetryMs[i] = D_WS_RECONNECT_MIN;
+    }
     myJS = NULL;
     if (true == gbDevJs) {
         myJS = new CJoyStick;
@@ -154,9 +182,24 @@ void CGtCtrl::signal_handler(int signo)
     }
 }
 
+/**
+ * @brief SetFleet
+ *        simulate many vehicles instead of the joystick driven one,
+ *        call before Initialize()
+ * @param vehicles number of vehicles, 0: single vehicle
+ * @param threads  number of threads, 0: number of CPUs
+ * @param script   input script of CFleet, NULL: random inputs
+ */
+void CGtCtrl::SetFleet(int vehicles, int threads, const char *script)
+{
+    m_nFleetSize = vehicles;
+    m_nFleetThreads = threads;
+    m_strFleetScript = (NULL == script) ? "" : script;
+}
 
 bool CGtCtrl::Initialize()
 {
+    clock_gettime(CLOCK_MONOTONIC, &m_tsStart);
     m_nJoyStickID = -1;
 
     m_stVehicleInfo.fLng = g_StartLongitude;
@@ -184,79 +227,456 @@ bool CGtCtrl::Initialize()
         return false;
     }
 
-    m_sendMsgInfo.clear();
+    /**
+     * resolve names once, the send path only uses handles
+     */
+    for (int i = 0; i < VI_KEY_MAX; i++) {
+        m_viKey[i] = m_viList.add(g_viKeyName[i]);
+        if (0 >= m_viList.getPriority(m_viKey[i])) {
+            m_viList.setPriority(m_viKey[i], g_viKeyPriority[i]);
+        }
+    }
+    m_sched.SetDeferLevel(D_SEND_DEFER_PRIORITY - 1);
+
+    m_sentKey.resize(m_viList.length());
+    m_policy.Resize(m_viList.length());
+    for (int id = 0; id < m_viList.length(); id++) {
+        m_policy.Bind(id, m_viList.getName(id));
+    }
+
+    if (0 < m_nFleetSize) {
+        int threads = m_nFleetThreads;
+        if (0 >= threads) {
+            threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if (0 >= threads) {
+            threads = 1;
+        }
+        if (D_FLEET_MAX_THREADS < threads) {
+            threads = D_FLEET_MAX_THREADS;
+        }
+        if (!m_fleet.Open(m_nFleetSize, threads, myConf.m_fLat,
+                          myConf.m_fLng, D_FLEET_SEED)) {
+            printf("Fleet open error\n");
+            return false;
+        }
+        if ((!m_strFleetScript.empty()) &&
+            (!m_fleet.LoadScript(m_strFleetScript.c_str()))) {
+            return false;
+        }
+        printf("Fleet: %d vehicles, %d threads\n", m_fleet.GetSize(),
+               m_fleet.GetThreads());
+    }
+    else {
+        int nRet = myJS->Open();
+        if (nRet < 0) {
+            printf("JoyStick open error\n");
+            return false;
+        }
+    }
 
-    int nRet = myJS->Open();
-    if (nRet < 0) {
-        printf("JoyStick open error\n");
+    if (!m_loop.Open()) {
         return false;
     }
 
     /* Modify I/F MessageQueue -> Websocket Start */
-    if (!m_websocket_client[0].start(m_websocket_port[0], "lo",
-                                     protocols,
-                                     &m_websocket_mutex[0],
-                                     &m_websocket_cond[0],
-                                     &m_websocket_queue[0])) {
+    if (!m_transport.open("lo", protocols, &m_loop)) {
         return false;
     }
-    if (pthread_cond_wait(&m_websocket_cond[0], &m_websocket_mutex[0]) != 0) {
-        std::cerr << "Failed to wait signal" << std::endl;
+    SchedRecord none;
+    none.id = -1;
+    none.size = -1;
+    for (int i = 0; i < 4; i++) {
+        m_snapshot[i].assign(m_viList.length(), none);
+        m_websocket_client[i].setAttemptTimeout(D_WS_RECONNECT_MAX);
+        if (!m_websocket_client[i].start(&m_transport, m_websocket_port[i],
+                                         protocols[i].name, NULL, NULL,
+                                         &m_websocket_queue[i])) {
+            return false;
+        }
+    }
+
+    /**
+     * the handshakes proceed together while dispatching, a port not
+     * connected in time is left to SuperviseConnections()
+     */
+    int timeout = myConf.m_nConnectTimeout;
+    int nUp = 0;
+    while (true) {
+        nUp = 0;
+        for (int i = 0; i < 4; i++) {
+            if (m_websocket_client[i].isConnected()) {
+                nUp++;
+            }
+        }
+        if ((4 == nUp) ||
+            ((0 < timeout) && (StartupTime() >= (double) timeout))) {
+            break;
+        }
+        if (0 > m_loop.Dispatch(D_WS_CONNECT_POLL)) {
+            return false;
+        }
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (int i = 0; i < 4; i++) {
+        if (m_websocket_client[i].isConnected()) {
+            printf("websocket port %d connected in %.1fms\n",
+                   m_websocket_port[i],
+                   m_websocket_client[i].firstConnectTime());
+            m_bConnUp[i] = true;
+        }
+        else {
+            printf("websocket port %d not connected in %dms, retrying\n",
+                   m_websocket_port[i], timeout);
+            m_bConnUp[i] = false;
+            m_nRetryMs[i] = D_WS_RECONNECT_MIN;
+            m_tsRetry[i] = now;
+        }
+    }
+    printf("startup: %d/4 websocket connections in %.1fms\n", nUp,
+           StartupTime());
+
+    m_bFastGeodesy = (0 != myConf.m_nFastGeodesy);
+    m_bBatch = (0 != myConf.m_nBatch);
+    for (int i = 0; i < 4; i++) {
+        m_websocket_client[i].setBatch(m_bBatch);
+    }
+    m_clock.GetTimeOfDay(&m_tvTick);
+
+    /**
+     * compact format is used after AMB acknowledged the name table
+     */
+    m_bCompact = (0 != myConf.m_nCompact);
+    if (m_bCompact) {
+        for (int i = 0; i < 4; i++) {
+            SendNameTable((ProtocolType) i);
+        }
+    }
+
+    if (0 == m_nFleetSize) {
+        VehicleInfoKey vi = VI_LOCATION;
+        double location[] = { myConf.m_fLat, myConf.m_fLng, 0 };
+        SendVehicleInfo(dataport_def, vi, &location[0], 3);
+        FlushVehicleInfo();
+    }
+
+    return true;
+}
+
+bool CGtCtrl::Terminate()
+{
+    bool b = true;
+
+    myJS->Close();
+    m_trace.Close();
+    m_fleet.Close();
+    m_loop.Close();
+    for (int i = 0; i < 4; i++) {
+        printf("send[%d]: msgs=%lu copies=%lu allocs=%lu\n", i,
+               m_websocket_client[i].sendCount(),
+               m_websocket_client[i].copyCount(),
+               m_websocket_client[i].allocCount());
+        if ((0 != m_websocket_queue[i].overflowCount()) ||
+            (0 != m_websocket_queue[i].oversizeCount())) {
+            printf("recv queue[%d]: dropped %lu(full) %lu(too large)\n", i,
+                   m_websocket_queue[i].overflowCount(),
+                   m_websocket_queue[i].oversizeCount());
+        }
+    }
+    return b;
+}
+
+/**
+ * @brief joystick fd event
+ *        only mark readiness, the event is read in the run loop
+ */
+void CGtCtrl::js_handler(int fd, unsigned int events, void *arg)
+{
+    CGtCtrl *p = reinterpret_cast < CGtCtrl * >(arg);
+    if (events & (POLLERR | POLLHUP)) {
+        printf("JoyStick disconnected\n");
+        p->m_loop.Remove(fd);
+        return;
+    }
+    if (events & POLLIN) {
+        p->m_bJsReady = true;
+    }
+}
+
+/**
+ * @brief tick timer event
+ */
+void CGtCtrl::tick_handler(int /*fd*/, unsigned int /*events*/, void *arg)
+{
+    CGtCtrl *p = reinterpret_cast < CGtCtrl * >(arg);
+    if (0 < p->m_tick.Wait()) {
+        p->m_bTickReady = true;
+    }
+}
+
+/**
+ * @brief SetHeadless
+ *        run on virtual time as fast as possible instead of the tick
+ *        timer, call before Initialize()
+ * @param duration virtual time to stop after [sec], 0: no limit
+ */
+void CGtCtrl::SetHeadless(double duration)
+{
+    m_clock.SetVirtual(true);
+    m_bHeadless = true;
+    m_dSimDuration = duration;
+    /* idle RPM jitter of CAvgEngine, same sequence on every run */
+    srand(1);
+}
+
+/**
+ * @brief SetRecord
+ *        record the joystick events, route text and step times of the
+ *        run loop, call before Initialize().
+ *        the clock only moves at steps, so everything sent between two
+ *        steps carries the same time in the recording and in the replay
+ * @param path trace file, created when the run loop starts
+ */
+void CGtCtrl::SetRecord(const char *path)
+{
+    m_strRecord = path;
+    if (!m_bHeadless) {
+        m_clock.SetVirtual(true);
+    }
+    /* idle RPM jitter of CAvgEngine, same sequence as the replay */
+    srand(1);
+}
+
+/**
+ * @brief SetReplay
+ *        replace the joystick and the clock by a recorded trace,
+ *        call before Initialize()
+ * @param path trace file written by SetRecord()
+ * @param speed 1: real time, N: N times faster, 0: as fast as possible
+ * @return true:success false:failure
+ */
+bool CGtCtrl::SetReplay(const char *path, double speed)
+{
+    if (!m_trace.Open(path)) {
+        return false;
     }
-    if (!m_websocket_client[1].start(m_websocket_port[1], "lo",
-                                     protocols2,
-                                     &m_websocket_mutex[1],
-                                     &m_websocket_cond[1],
-                                     &m_websocket_queue[1])) {
+    unsigned int flags;
+    struct timespec ts;
+    struct timeval tv;
+    if (!m_trace.NextStep(&flags, &ts, &tv)) {
+        printf("replay: empty trace %s\n", path);
+        m_trace.Close();
         return false;
     }
-    if (pthread_cond_wait(&m_websocket_cond[1], &m_websocket_mutex[1]) != 0) {
-        std::cerr << "Failed to wait signal" << std::endl;
+    /* the first step is the start time of the recorded run loop */
+    m_clock.SetVirtual(true);
+    m_clock.Set(&ts, &tv);
+    m_dReplaySpeed = speed;
+    srand(1);
+
+    if (NULL != myJS) {
+        delete myJS;
+    }
+    myJS = new CJoyStickReplay(&m_trace);
+    return true;
+}
+
+/**
+ * @brief SetVirtualJoyStick
+ *        use a drive script or a UNIX socket instead of the joystick
+ *        device, call before Initialize()
+ * @param source CJoyStickVirtual::SCRIPT / SOCKET
+ * @param path script file or socket path
+ */
+void CGtCtrl::SetVirtualJoyStick(CJoyStickVirtual::SOURCE source,
+                                 const char *path)
+{
+    if (NULL != myJS) {
+        delete myJS;
+    }
+    myJS = new CJoyStickVirtual(source, path, &myConf, &m_clock);
+}
+
+/**
+ * @brief StartTick
+ *        start the tick of a run loop
+ * @param hz tick rate
+ * @return true:success false:failure
+ */
+bool CGtCtrl::StartTick(int hz)
+{
+    m_nTickNsec = 1000000000L / hz;
+    if (m_trace.IsReplaying()) {
+        if (hz != m_trace.GetTickRate()) {
+            printf("replay: trace was recorded at %dHz, run loop is %dHz\n",
+                   m_trace.GetTickRate(), hz);
+            return false;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &m_tsReplayReal);
+        m_clock.GetTime(&m_tsReplayTrace);
+        return true;
+    }
+    if (!m_strRecord.empty()) {
+        if (!m_trace.Create(m_strRecord.c_str(), hz)) {
+            return false;
+        }
+        struct timespec ts;
+        struct timeval tv;
+        m_clock.GetTime(&ts);
+        m_clock.GetTimeOfDay(&tv);
+        m_trace.WriteStep(0, &ts, &tv);
+    }
+    if (m_bHeadless) {
+        /* every dispatch is a tick, no timer */
+        return true;
     }
-    if (!m_websocket_client[2].start(m_websocket_port[2], "lo",
-                                     protocols3,
-                                     &m_websocket_mutex[2],
-                                     &m_websocket_cond[2],
-                                     &m_websocket_queue[2])) {
+    if (!m_tick.Start(hz)) {
+        printf("tick timer start error\n");
         return false;
     }
-    if (pthread_cond_wait(&m_websocket_cond[2], &m_websocket_mutex[2]) != 0) {
-        std::cerr << "Failed to wait signal" << std::endl;
+    m_loop.Add(m_tick.GetFd(), POLLIN, CGtCtrl::tick_handler, this);
+    return true;
+}
+
+/**
+ * @brief DispatchTick
+ *        wait for events of the run loop.
+ *        on virtual time only pending events are handled and every call
+ *        advances the clock by one tick.
+ * @return false:event loop error
+ */
+bool CGtCtrl::DispatchTick()
+{
+    m_bJsReady = false;
+    m_bTickReady = false;
+    if (m_trace.IsReplaying()) {
+        return ReplayTick();
     }
-    if (!m_websocket_client[3].start(m_websocket_port[3], "lo",
-                                     protocols4,
-                                     &m_websocket_mutex[3],
-                                     &m_websocket_cond[3],
-                                     &m_websocket_queue[3])) {
+    if (0 > m_loop.Dispatch(m_bHeadless ? 0 : -1)) {
         return false;
     }
-    if (pthread_cond_wait(&m_websocket_cond[3], &m_websocket_mutex[3]) != 0) {
-        std::cerr << "Failed to wait signal" << std::endl;
+    if (m_bHeadless) {
+        m_clock.Advance(m_nTickNsec);
+        m_bTickReady = true;
+        if ((0.0 < m_dSimDuration) &&
+            (m_clock.GetElapsed() >= m_dSimDuration)) {
+            g_bStopFlag = false;
+        }
+    }
+    if (m_bTickReady && (0 > myJS->GetFd())) {
+        /* an input source without descriptor is read on every tick */
+        m_bJsReady = true;
     }
+    if (m_trace.IsRecording() && (m_bJsReady || m_bTickReady)) {
+        RecordTick();
+    }
+    m_clock.GetTimeOfDay(&m_tvTick);
+    return true;
+}
 
-    const char *vi = "LOCATION";
-    double location[] = { myConf.m_fLat, myConf.m_fLng, 0 };
-    SendVehicleInfo(dataport_def, vi, &location[0], 3);
+/**
+ * @brief RecordTick
+ *        start a step of the trace, on real time the clock is moved to
+ *        the current time first
+ */
+void CGtCtrl::RecordTick()
+{
+    struct timespec ts;
+    struct timeval tv;
+    if (!m_bHeadless) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        gettimeofday(&tv, NULL);
+        m_clock.Set(&ts, &tv);
+    }
+    m_clock.GetTime(&ts);
+    m_clock.GetTimeOfDay(&tv);
+    unsigned int flags = (m_bTickReady ? D_TRACE_STEP_TICK : 0) |
+        (m_bJsReady ? D_TRACE_STEP_JS : 0);
+    if (!m_trace.WriteStep(flags, &ts, &tv)) {
+        printf("record: write error, stop recording\n");
+        m_trace.Close();
+    }
+}
 
+/**
+ * @brief ReplayTick
+ *        take the next step of the trace instead of waiting for events.
+ *        the step is delayed to its recorded time divided by the replay
+ *        speed, speed 0 does not wait at all.
+ * @return false:event loop error
+ */
+bool CGtCtrl::ReplayTick()
+{
+    if (0 > m_loop.Dispatch(0)) {
+        return false;
+    }
+    unsigned int flags;
+    struct timespec ts;
+    struct timeval tv;
+    if (!m_trace.NextStep(&flags, &ts, &tv)) {
+        printf("replay: end of trace\n");
+        g_bStopFlag = false;
+        return true;
+    }
+    if (0.0 < m_dReplaySpeed) {
+        double sec = (double) (ts.tv_sec - m_tsReplayTrace.tv_sec) +
+            (double) (ts.tv_nsec - m_tsReplayTrace.tv_nsec) / 1000000000.0;
+        long nsec = (long) (sec / m_dReplaySpeed * 1000000000.0);
+        struct timespec deadline = m_tsReplayReal;
+        deadline.tv_sec += nsec / 1000000000L;
+        deadline.tv_nsec += nsec % 1000000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                        &deadline, NULL)) {
+        }
+    }
+    m_clock.Set(&ts, &tv);
+    m_bTickReady = (0 != (flags & D_TRACE_STEP_TICK));
+    m_bJsReady = (0 != (flags & D_TRACE_STEP_JS));
+    m_clock.GetTimeOfDay(&m_tvTick);
     return true;
 }
 
-bool CGtCtrl::Terminate()
+/**
+ * @brief StopTick
+ *        stop the tick of a run loop
+ */
+void CGtCtrl::StopTick()
 {
-    bool b = true;
+    if (m_trace.IsRecording() || m_trace.IsReplaying()) {
+        printf("trace: steps=%lu\n", m_trace.GetStepCount());
+    }
+    PrintSendStats();
+    if (m_trace.IsReplaying()) {
+        return;
+    }
+    if (m_bHeadless) {
+        printf("tick: virtual time=%.1fsec\n", m_clock.GetElapsed());
+        return;
+    }
+    printf("tick: rate=%dHz ticks=%lu overruns=%lu\n", m_tick.GetRate(),
+           m_tick.GetTickCount(), m_tick.GetOverrunCount());
+    m_loop.Remove(m_tick.GetFd());
+    m_tick.Stop();
+}
 
-    myJS->Close();
-    return b;
+/**
+ * @brief IntervalCount
+ *        ticks between two interval sends at a tick rate, the rates are
+ *        validated by CConf::LoadConfig()
+ * @param tickHz tick rate
+ * @return ticks per interval, at least 1
+ */
+int CGtCtrl::IntervalCount(int tickHz) const
+{
+    const int n = tickHz / myConf.m_nIntervalHz;
+    return (n < 1) ? 1 : n;
 }
 
-#define sENGINE_SPEED   "ENGINE_SPEED"
-#define sBRAKE_SIGNAL   "BRAKE_SIGNAL"
-#define sBRAKE_PRESSURE "BRAKE_PRESSURE"
-#define sACCPEDAL_OPEN  "ACCPEDAL_OPEN"
-#define sVELOCITY       "VELOCITY"
-#define sDIRECTION      "DIRECTION"
-#define sLOCATION       "LOCATION"
-#define sSHIFT          "SHIFT"
 void CGtCtrl::Run()
 {
     g_bStopFlag = true;
@@ -265,19 +685,19 @@ void CGtCtrl::Run()
     int number = -1;
     int value = -1;
 
+    /**
+     * TICK / INTERVAL RATE
+     */
+    const int tickHz = m_trace.IsReplaying() ? m_trace.GetTickRate() :
+        myConf.m_nTickHz;
     /**
       * INTERVAL WAIT COUNTER
       */
-    int iwc = D_RUNLOOP_INTERVAL_COUNT;
+    const int intervalCount = IntervalCount(tickHz);
+    int iwc = intervalCount - 1;
     /**
      * RPM/Breake/Speed calc class
      */
-    int nRPM = -1;
-    bool bBrakeSigSend = false;
-    bool bBrakeSig = false;
-    int nBrakePressure = -1;
-    int nAccPedalOpen = -1;
-    int nSpeed = -1;
     CAvgCar pmCar(g_RPM_SAMPLE_SPACE_SIZE, g_SPEED_SAMPLE_SPACE_SIZE,
                         g_BREAKE_SAMPLE_SPACE_SIZE);
     pmCar.chgGear(CAvgGear::E_SHIFT_PARKING);
@@ -288,154 +708,200 @@ void CGtCtrl::Run()
     /**
      * SHIFT
      */
-    int nShiftPosBK = -1;
     char shiftpos = 255;
+    /**
+     * TURN SIGNAL
+     */
+    int nTurnSignal = 0;
+
+    /**
+     * send decisions go through the publish policy, RPM keeps its
+     * interval rate unless the AMB config has a rule for it
+     */
+    m_policy.Reset();
+    m_policy.SetDefaultMinInterval(m_viKey[VI_ENGINE_SPEED],
+                                   1000 * intervalCount / tickHz);
+
+    pmCar.setClock(&m_clock);
+
+    if (!StartTick(tickHz)) {
+        return;
+    }
+    m_jsInput.clear();
+    m_jsInput.trace = m_trace.IsRecording() ? &m_trace : NULL;
+    m_loop.Add(myJS->GetFd(), POLLIN, CGtCtrl::js_handler, this);
     while (g_bStopFlag) {
+        /**
+         * sleep until joystick input, websocket traffic or next tick
+         */
+        SuperviseConnections();
+        FlushVehicleInfo();
+        CheckRecvMessage();
+        if (!DispatchTick()) {
+            break;
+        }
 
-        type = myJS->Read(&number, &value);
+        if (m_bJsReady) {
+            myJS->ReadBatch(&m_jsInput);
+        }
+        if (!m_bTickReady) {
+            continue;
+        }
 
-        m_sendMsgInfo.clear();
+        m_sentKey.clear();
+        struct timespec now;
+        m_clock.GetTime(&now);
 
-        switch (type) {
-        case JS_EVENT_AXIS:
-            if (number == myConf.m_nSteering) {
-                if (value != 0) {
-                    m_stVehicleInfo.nSteeringAngle +=
-                        (value * 10 / 65536 - m_stVehicleInfo.nSteeringAngle);
-                }
-                {
-                    const char *vi = "STEERING";
+        /**
+         * apply the coalesced input of this tick
+         */
+        while (m_jsInput.pop(&type, &number, &value)) {
+            switch (type) {
+            case JS_EVENT_AXIS:
+                if (number == myConf.m_nSteering) {
+                    if (value != 0) {
+                        m_stVehicleInfo.nSteeringAngle +=
+                            (value * 10 / 65536 -
+                             m_stVehicleInfo.nSteeringAngle);
+                    }
+                    {
+                        VehicleInfoKey vi = VI_STEERING;
 
-                    SendVehicleInfo(dataport_def,
-                                    vi, m_stVehicleInfo.nSteeringAngle);
+                        SendVehicleInfo(dataport_def,
+                                        vi, m_stVehicleInfo.nSteeringAngle);
+                        m_policy.Sent(m_viKey[vi],
+                                      m_stVehicleInfo.nSteeringAngle, &now);
+                    }
                 }
-            }
 
-            if (number == myConf.m_nAccel) {
-                if (0 == value) {
-                    pmCar.chgThrottle(32767);
-                    pmCar.chgBrake(32767);
-                }
-                else if (0 < value) {
-                    pmCar.chgThrottle(32767);
-                    pmCar.chgBrake((value - 16384) * -2);
-                }
-                else {
-                    pmCar.chgThrottle((abs(value) - 16384) * -2);
-                    pmCar.chgBrake(32767);
+                if (number == myConf.m_nAccel) {
+                    if (0 == value) {
+                        pmCar.chgThrottle(32767);
+                        pmCar.chgBrake(32767);
+                    }
+                    else if (0 < value) {
+                        pmCar.chgThrottle(32767);
+                        pmCar.chgBrake((value - 16384) * -2);
+                    }
+                    else {
+                        pmCar.chgThrottle((abs(value) - 16384) * -2);
+                        pmCar.chgBrake(32767);
+                    }
                 }
-            }
-            break;
-        case JS_EVENT_BUTTON:
-            /**
-             * Gear Change SHIFT UP
-             */
-            if (number == myConf.m_nShiftU) {
-                if (value != 0) {
-                    pmCar.setShiftUp();
-                    m_stVehicleInfo.nShiftPos = pmCar.getSelectGear();
-                    shiftpos = pmCar.getValue();
+                break;
+            case JS_EVENT_BUTTON:
+                /**
+                 * Gear Change SHIFT UP
+                 */
+                if (number == myConf.m_nShiftU) {
+                    if (value != 0) {
+                        pmCar.setShiftUp();
+                        m_stVehicleInfo.nShiftPos = pmCar.getSelectGear();
+                        shiftpos = pmCar.getValue();
+                    }
                 }
-            }
-            /**
-             * Gear Change SHIFT DOWN
-             */
-            if (number == myConf.m_nShiftD) {
-                if (value != 0) {
-                    pmCar.setShiftDown();
-                    m_stVehicleInfo.nShiftPos = pmCar.getSelectGear();
-                    shiftpos = pmCar.getValue();
+                /**
+                 * Gear Change SHIFT DOWN
+                 */
+                if (number == myConf.m_nShiftD) {
+                    if (value != 0) {
+                        pmCar.setShiftDown();
+                        m_stVehicleInfo.nShiftPos = pmCar.getSelectGear();
+                        shiftpos = pmCar.getValue();
+                    }
                 }
-            }
 
-            if (number == myConf.m_nWinkR) {
-                if (value != 0) {
-
-                    m_stVehicleInfo.bWinkR = !m_stVehicleInfo.bWinkR;
-                    if (m_stVehicleInfo.bWinkR)
-                        m_stVehicleInfo.nWinkerPos = WINKER_RIGHT;
-                    else
-                        m_stVehicleInfo.nWinkerPos = WINKER_OFF;
-
-                    const char *vi = "TURN_SIGNAL";
-                    int wpos =
-                        m_stVehicleInfo.nWinkerPos == WINKER_RIGHT ? 1 : 0;
-                    SendVehicleInfo(dataport_def, vi, wpos);
+                if (number == myConf.m_nWinkR) {
+                    if (value != 0) {
+
+                        m_stVehicleInfo.bWinkR = !m_stVehicleInfo.bWinkR;
+                        if (m_stVehicleInfo.bWinkR)
+                            m_stVehicleInfo.nWinkerPos = WINKER_RIGHT;
+                        else
+                            m_stVehicleInfo.nWinkerPos = WINKER_OFF;
+
+                        VehicleInfoKey vi = VI_TURN_SIGNAL;
+                        int wpos =
+                            m_stVehicleInfo.nWinkerPos == WINKER_RIGHT ? 1 : 0;
+                        SendVehicleInfo(dataport_def, vi, wpos);
+                        m_policy.Sent(m_viKey[vi], wpos, &now);
+                        nTurnSignal = wpos;
+                    }
                 }
-            }
-
-            if (number == myConf.m_nWinkL) {
-                if (value != 0) {
-                    m_stVehicleInfo.bWinkL = !m_stVehicleInfo.bWinkL;
-                    if (m_stVehicleInfo.bWinkL)
-                        m_stVehicleInfo.nWinkerPos = WINKER_LEFT;
-                    else
-                        m_stVehicleInfo.nWinkerPos = WINKER_OFF;
 
-                    const char *vi = "TURN_SIGNAL";
-                    int wpos =
-                        m_stVehicleInfo.nWinkerPos == WINKER_LEFT ? 2 : 0;
-                    SendVehicleInfo(dataport_def, vi, wpos);
+                if (number == myConf.m_nWinkL) {
+                    if (value != 0) {
+                        m_stVehicleInfo.bWinkL = !m_stVehicleInfo.bWinkL;
+                        if (m_stVehicleInfo.bWinkL)
+                            m_stVehicleInfo.nWinkerPos = WINKER_LEFT;
+                        else
+                            m_stVehicleInfo.nWinkerPos = WINKER_OFF;
+
+                        VehicleInfoKey vi = VI_TURN_SIGNAL;
+                        int wpos =
+                            m_stVehicleInfo.nWinkerPos == WINKER_LEFT ? 2 : 0;
+                        SendVehicleInfo(dataport_def, vi, wpos);
+                        m_policy.Sent(m_viKey[vi], wpos, &now);
+                        nTurnSignal = wpos;
+                    }
                 }
-            }
 
-            break;
+                break;
+            }
         }
         pmCar.updateAvg();
         /**
          * RPM check
          */
         int rpmNEW = (int)pmCar.getRPM();
-        if ((iwc==0)&&(rpmNEW != nRPM)) {
-            SendVehicleInfo(dataport_def, sENGINE_SPEED, rpmNEW);
-            nRPM = rpmNEW; // update value
+        if (m_policy.Update(m_viKey[VI_ENGINE_SPEED], rpmNEW, &now)) {
+            SendVehicleInfo(dataport_def, VI_ENGINE_SPEED, rpmNEW);
         }
         int apoNEW = pmCar.calcAccPedalOpen();
-        if (apoNEW != nAccPedalOpen) {
-            SendVehicleInfo(dataport_def, sACCPEDAL_OPEN, apoNEW);
-            nAccPedalOpen = apoNEW;
+        if (m_policy.Update(m_viKey[VI_ACCPEDAL_OPEN], apoNEW, &now)) {
+            SendVehicleInfo(dataport_def, VI_ACCPEDAL_OPEN, apoNEW);
         }
         /**
          * BRAKE SIGNAL
          */
         bool bBrakeNEW = pmCar.isOnBrake();
         m_stVehicleInfo.bBrake = bBrakeNEW;
-        if ((false == bBrakeSigSend) || (bBrakeNEW != bBrakeSig)) {
-            bBrakeSigSend = true;
-            SendVehicleInfo(dataport_def, sBRAKE_SIGNAL, bBrakeNEW);
-            bBrakeSig = bBrakeNEW; // update value
+        if (m_policy.Update(m_viKey[VI_BRAKE_SIGNAL], bBrakeNEW, &now)) {
+            SendVehicleInfo(dataport_def, VI_BRAKE_SIGNAL, bBrakeNEW);
         }
         /**
          * BRAKE PRESSURE
          */
         int pressureNEW = pmCar.calcPressure(pmCar.getBrakeAvg());
         m_stVehicleInfo.nBrakeHydraulicPressure = pressureNEW;
-        if (pressureNEW != nBrakePressure) {
-            SendVehicleInfo(dataport_def, sBRAKE_PRESSURE, pressureNEW);
-            nBrakePressure = pressureNEW;
+        if (m_policy.Update(m_viKey[VI_BRAKE_PRESSURE], pressureNEW, &now)) {
+            SendVehicleInfo(dataport_def, VI_BRAKE_PRESSURE, pressureNEW);
         }
 
         /**
          * VELOCITY (SPEED)
          */
         int speedNew = (int)pmCar.getSpeed();
-        if (speedNew != nSpeed) {
-            SendVehicleInfo(dataport_def, sVELOCITY, speedNew);
-            m_stVehicleInfo.nVelocity = speedNew;
-            nSpeed = speedNew;
+        myJS->SetFeedback(pmCar.getSpeed());
+        m_stVehicleInfo.nVelocity = speedNew;
+        if (m_policy.Update(m_viKey[VI_VELOCITY], speedNew, &now)) {
+            SendVehicleInfo(dataport_def, VI_VELOCITY, speedNew);
         }
         /**
          * SHIFT
          */
-        if (nShiftPosBK != m_stVehicleInfo.nShiftPos) {
-            const size_t ShiftSz = 3;                                                              
-            int data[ShiftSz];                                                                    
-            int val = pmCar.getValue();
+        {
+            const size_t ShiftSz = 3;
+            int data[ShiftSz];
             data[0] = pmCar.getSelectGear();
             data[1] = pmCar.getValue();
             data[2] = pmCar.getMode();
-            SendVehicleInfo(dataport_def, sSHIFT, &data[0], ShiftSz);
-            nShiftPosBK = m_stVehicleInfo.nShiftPos;
+            double v[ShiftSz] = {
+                (double) data[0], (double) data[1], (double) data[2]
+            };
+            if (m_policy.Update(m_viKey[VI_SHIFT], &v[0], ShiftSz, &now)) {
+                SendVehicleInfo(dataport_def, VI_SHIFT, &data[0], ShiftSz);
+            }
         }
 
         if (iwc == 0) {
@@ -448,12 +914,8 @@ void CGtCtrl::Run()
             if (0 != runMeters) {
                 double stear = (double)m_stVehicleInfo.nSteeringAngle;
                 double dirNEW = CalcAzimuth(dir, stear, runMeters);
-                int nDir = (int)dirNEW;
                 dir = dirNEW;
-                if (nDir != m_stVehicleInfo.nDirection) {
-                    SendVehicleInfo(dataport_def, sDIRECTION, nDir);
-                    m_stVehicleInfo.nDirection = nDir;
-                }
+                m_stVehicleInfo.nDirection = (int)dirNEW;
             }
             /**
               * LOCATION
@@ -461,26 +923,143 @@ void CGtCtrl::Run()
             if ((!m_bUseGps) && (0 != runMeters)) {
                 double tmpLat = m_stVehicleInfo.fLat;
                 double tmpLng = m_stVehicleInfo.fLng;
-                POINT pNEW = CalcDest(tmpLat, tmpLng, dir, runMeters);
-                if ((tmpLat != pNEW.lat) || (tmpLng != pNEW.lng)){
-                    double tmpLct[] = { pNEW.lat, pNEW.lng, 0 };
-                    SendVehicleInfo(dataport_def, sLOCATION, &tmpLct[0], 3);
-                    m_stVehicleInfo.fLat = pNEW.lat;
-                    m_stVehicleInfo.fLng = pNEW.lng;
+                POINT pNEW;
+                if (m_bFastGeodesy) {
+                    pNEW = CalcDestFast(tmpLat, tmpLng, dir, runMeters,
+                                        &m_geoRadii);
                 }
+                else {
+                    pNEW = CalcDest(tmpLat, tmpLng, dir, runMeters);
+                }
+                m_stVehicleInfo.fLat = pNEW.lat;
+                m_stVehicleInfo.fLng = pNEW.lng;
             }
         }
+        if (m_policy.Update(m_viKey[VI_DIRECTION], m_stVehicleInfo.nDirection,
+                            &now)) {
+            SendVehicleInfo(dataport_def, VI_DIRECTION,
+                            m_stVehicleInfo.nDirection);
+        }
+        if (!m_bUseGps) {
+            double tmpLct[] = { m_stVehicleInfo.fLat, m_stVehicleInfo.fLng, 0 };
+            if (m_policy.Update(m_viKey[VI_LOCATION], &tmpLct[0], 3, &now)) {
+                SendVehicleInfo(dataport_def, VI_LOCATION, &tmpLct[0], 3);
+            }
+        }
+        /**
+         * heartbeat of the properties sent on input events
+         */
+        if (m_policy.Update(m_viKey[VI_STEERING],
+                            m_stVehicleInfo.nSteeringAngle, &now)) {
+            SendVehicleInfo(dataport_def, VI_STEERING,
+                            m_stVehicleInfo.nSteeringAngle);
+        }
+        if (m_policy.Update(m_viKey[VI_TURN_SIGNAL], nTurnSignal, &now)) {
+            SendVehicleInfo(dataport_def, VI_TURN_SIGNAL, nTurnSignal);
+        }
         if (0 == iwc) {
-            iwc = D_RUNLOOP_INTERVAL_COUNT;
+            iwc = intervalCount - 1;
+        }
+        else {
+            iwc--;
+        }
+    }
+    FlushVehicleInfo();
+    m_loop.Remove(myJS->GetFd());
+    StopTick();
+    printf("policy: suppressed=%lu heartbeats=%lu\n",
+           m_policy.GetSuppressCount(), m_policy.GetHeartbeatCount());
+}
+
+/**
+ * @brief RunFleet
+ *        run loop of fleet mode, all vehicles step on the tick and their
+ *        changes go out as fleet tagged records of one batch frame
+ */
+void CGtCtrl::RunFleet()
+{
+    g_bStopFlag = true;
+
+    const int tickHz = myConf.m_nTickHz;
+    const int intervalCount = IntervalCount(tickHz);
+    int iwc = intervalCount - 1;
+    const double dt = 1.0 / tickHz;
+
+    /**
+     * last sent values, allocated once
+     */
+    const int n = m_fleet.GetSize();
+    std::vector<int> nSpeed(n, -1);
+    std::vector<int> nRPM(n, -1);
+    std::vector<int> nDir(n, -1);
+    std::vector<double> fLat(n, 0.0);
+    std::vector<double> fLng(n, 0.0);
+
+    /* thousands of records per tick, one frame per connection */
+    m_bBatch = true;
+    for (int i = 0; i < 4; i++) {
+        m_websocket_client[i].setBatch(true);
+    }
+
+    if (!StartTick(tickHz)) {
+        return;
+    }
+    while (g_bStopFlag) {
+        SuperviseConnections();
+        FlushVehicleInfo();
+        CheckRecvMessage();
+        if (!DispatchTick()) {
+            break;
+        }
+        if (!m_bTickReady) {
+            continue;
+        }
+        m_sentKey.clear();
+
+        m_fleet.Step(dt);
+
+        const double *speed = m_fleet.GetSpeed();
+        for (int i = 0; i < n; i++) {
+            int v = (int) speed[i];
+            if (v != nSpeed[i]) {
+                SendFleetInfo(i, VI_VELOCITY, v);
+                nSpeed[i] = v;
+            }
+        }
+
+        if (0 == iwc) {
+            iwc = intervalCount - 1;
+            const double *rpm = m_fleet.GetRPM();
+            const double *azim = m_fleet.GetAzimuth();
+            const double *lat = m_fleet.GetLat();
+            const double *lng = m_fleet.GetLng();
+            for (int i = 0; i < n; i++) {
+                int r = (int) rpm[i];
+                if (r != nRPM[i]) {
+                    SendFleetInfo(i, VI_ENGINE_SPEED, r);
+                    nRPM[i] = r;
+                }
+                int d = (int) azim[i];
+                if (d != nDir[i]) {
+                    SendFleetInfo(i, VI_DIRECTION, d);
+                    nDir[i] = d;
+                }
+                if ((lat[i] != fLat[i]) || (lng[i] != fLng[i])) {
+                    double location[] = { lat[i], lng[i], 0 };
+                    SendFleetInfo(i, VI_LOCATION, &location[0], 3);
+                    fLat[i] = lat[i];
+                    fLng[i] = lng[i];
+                }
+            }
         }
         else {
             iwc--;
         }
-        /**
-         * Interval Wait
-         */
-        usleep(g_sleeptime);
     }
+    printf("fleet: vehicles=%d threads=%d time=%.1fsec\n", n,
+           m_fleet.GetThreads(), m_fleet.GetTime());
+    FlushVehicleInfo();
+    StopTick();
 }
 
 void CGtCtrl::Run2()
@@ -503,11 +1082,48 @@ void CGtCtrl::Run2()
 
     pthread_mutex_init(&mutex, NULL);
 
+    if (!StartTick(D_RUNLOOP2_TICK_HZ)) {
+        return;
+    }
+    m_loop.Add(myJS->GetFd(), POLLIN, CGtCtrl::js_handler, this);
     while (g_bStopFlag) {
-        type = myJS->Read(&number, &value);
+        SuperviseConnections();
+        FlushVehicleInfo();
+        CheckRecvMessage();
+        if (!DispatchTick()) {
+            break;
+        }
 
+        type = -1;
+        if (m_bJsReady) {
+            type = myJS->Read(&number, &value);
+            if (m_trace.IsRecording()) {
+                m_trace.WriteJs(type, number, value);
+            }
+        }
+
+        /**
+         * route text is taken on steps only (it is used on ticks),
+         * so a replay sees it at the same step
+         */
         pthread_mutex_lock(&mutex);
-        if (msgQueue.size() > 0) {
+        if (m_trace.IsReplaying()) {
+            const char *text;
+            int len;
+            if (m_trace.NextRoute(&text, &len)) {
+                msgQueue.assign(text, len);
+                while (m_trace.NextRoute(&text, &len)) {
+                    msgQueue.append(text, len);
+                }
+            }
+        }
+        if ((m_bJsReady || m_bTickReady) && (msgQueue.size() > 0)) {
+            if (m_trace.IsRecording() &&
+                !m_trace.WriteRoute(msgQueue.data(),
+                                    (int) msgQueue.size())) {
+                printf("record: write error, stop recording\n");
+                m_trace.Close();
+            }
             char buf[32];
             int pos = 0;
             int lastidx = 0;
@@ -569,8 +1185,8 @@ void CGtCtrl::Run2()
                 }
                 m_stVehicleInfo.nAccel = value;
 
-                const char *vi1 = "BRAKE_SIGNAL";
-                const char *vi2 = "BRAKE_PRESSURE";
+                VehicleInfoKey vi1 = VI_BRAKE_SIGNAL;
+                VehicleInfoKey vi2 = VI_BRAKE_PRESSURE;
                 SendVehicleInfo(dataport_def, vi1, m_stVehicleInfo.bBrake);
 
                 SendVehicleInfo(dataport_def,
@@ -611,7 +1227,7 @@ void CGtCtrl::Run2()
                     }
 
                     char data[] = { shiftpos, shiftpos, 0 };
-                    const char *vi = "SHIFT";
+                    VehicleInfoKey vi = VI_SHIFT;
                     SendVehicleInfo(dataport_def, vi, &data[0]);
 
                 }
@@ -654,7 +1270,7 @@ void CGtCtrl::Run2()
                     }
 
                     char data[] = { shiftpos, shiftpos, 0 };
-                    const char *vi = "SHIFT";
+                    VehicleInfoKey vi = VI_SHIFT;
                     SendVehicleInfo(dataport_def, vi, &data[0], 3);
                 }
             }
@@ -667,7 +1283,7 @@ void CGtCtrl::Run2()
                     else
                         m_stVehicleInfo.nWinkerPos = WINKER_OFF;
 
-                    const char *vi = "TURN_SIGNAL";
+                    VehicleInfoKey vi = VI_TURN_SIGNAL;
                     int wpos =
                         m_stVehicleInfo.nWinkerPos == WINKER_RIGHT ? 1 : 0;
                     SendVehicleInfo(dataport_def, vi, wpos);
@@ -682,7 +1298,7 @@ void CGtCtrl::Run2()
                     else
                         m_stVehicleInfo.nWinkerPos = WINKER_OFF;
 
-                    const char *vi = "TURN_SIGNAL";
+                    VehicleInfoKey vi = VI_TURN_SIGNAL;
                     int wpos =
                         m_stVehicleInfo.nWinkerPos == WINKER_LEFT ? 2 : 0;
                     SendVehicleInfo(dataport_def, vi, wpos);
@@ -691,6 +1307,9 @@ void CGtCtrl::Run2()
 
             break;
         }
+        if (!m_bTickReady) {
+            continue;
+        }
 
         if (m_stVehicleInfo.nAccel < 0) {
             m_stVehicleInfo.dVelocity +=
@@ -711,9 +1330,10 @@ void CGtCtrl::Run2()
         if (m_stVehicleInfo.dVelocity < 0)
             m_stVehicleInfo.dVelocity = 0.0;
 
+        myJS->SetFeedback(m_stVehicleInfo.dVelocity);
         if (m_stVehicleInfo.nVelocity != (int) m_stVehicleInfo.dVelocity) {
             m_stVehicleInfo.nVelocity = (int) m_stVehicleInfo.dVelocity;
-            const char *vi = "VELOCITY";
+            VehicleInfoKey vi = VI_VELOCITY;
             SendVehicleInfo(dataport_def, vi, m_stVehicleInfo.nVelocity);
         }
 
@@ -732,7 +1352,7 @@ void CGtCtrl::Run2()
                 m_stVehicleInfo.nDirection += 360;
 
             {
-                const char *vi = "DIRECTION";
+                VehicleInfoKey vi = VI_DIRECTION;
                 SendVehicleInfo(dataport_def, vi, m_stVehicleInfo.nDirection);
             }
 
@@ -750,7 +1370,7 @@ void CGtCtrl::Run2()
                 m_stVehicleInfo.fLat += dx * 0.000003;
                 m_stVehicleInfo.fLng += dy * 0.000003;
 
-                const char *vi = "LOCATION";
+                VehicleInfoKey vi = VI_LOCATION;
                 double location[] =
                     { m_stVehicleInfo.fLat, m_stVehicleInfo.fLng, 0 };
             }
@@ -779,7 +1399,7 @@ void CGtCtrl::Run2()
             }
 
             {
-                const char *vi = "DIRECTION";
+                VehicleInfoKey vi = VI_DIRECTION;
                 SendVehicleInfo(dataport_def, vi, m_stVehicleInfo.nDirection);
             }
             m_stVehicleInfo.fLat +=
@@ -790,7 +1410,7 @@ void CGtCtrl::Run2()
                                                                         111.111);
 
             {
-                const char *vi = "LOCATION";
+                VehicleInfoKey vi = VI_LOCATION;
                 double location[] =
                     { m_stVehicleInfo.fLat, m_stVehicleInfo.fLng, 0 };
             }
@@ -850,6 +1470,10 @@ void CGtCtrl::Run2()
         }
     }
 
+    FlushVehicleInfo();
+    m_loop.Remove(myJS->GetFd());
+    StopTick();
+
     pthread_join(thread[0], NULL);
     pthread_join(thread[1], NULL);
     while (!routeList.empty()) {
@@ -901,7 +1525,7 @@ void DaemonTerminate(int SigNo)
  * @param[in]   sendque_id  que id for sending
  * @param[in]   recvque_id  que id for receiving
  * @param[in]   mtype       priority
- * @param[in]   key         name of vehicle information
+ * @param[in]   key         vehicle information sent by carsim
  * @param[in]   comstat     common_status
  * @param[in]   data        value of vehicle information
  * @param[in]   len         length of vehicle information
@@ -910,41 +1534,65 @@ void DaemonTerminate(int SigNo)
  */
 /*--------------------------------------------------------------------------*/
 bool CGtCtrl::SendVehicleInfo( /*int & send_id, long mtype, */
-                              ProtocolType type, const char *key, bool data)
+                              ProtocolType type, VehicleInfoKey key, bool data)
 {
-    return sendVehicleInfo( /*send_id, mtype, */ type, key, (void *) &data,
-                           sizeof(bool), 1);
+    return sendVehicleInfo( /*send_id, mtype, */ type, m_viKey[key],
+                           (void *) &data, sizeof(bool), 1);
 }
 
 bool CGtCtrl::SendVehicleInfo( /*int & send_id, long mtype, */
-                              ProtocolType type, const char *key, int data)
+                              ProtocolType type, VehicleInfoKey key, int data)
 {
-    return sendVehicleInfo( /*send_id, mtype, */ type, key, (void *) &data,
-                           sizeof(int), 1);
+    return sendVehicleInfo( /*send_id, mtype, */ type, m_viKey[key],
+                           (void *) &data, sizeof(int), 1);
 }
 
 bool CGtCtrl::SendVehicleInfo( /*int & send_id, long mtype, */
-                              ProtocolType type, const char *key, int data[],
-                              int len)
+                              ProtocolType type, VehicleInfoKey key,
+                              int data[], int len)
 {
-    return sendVehicleInfo( /*send_id, mtype, */ type, key, (void *) data,
-                           sizeof(int), len);
+    return sendVehicleInfo( /*send_id, mtype, */ type, m_viKey[key],
+                           (void *) data, sizeof(int), len);
 }
 
 bool CGtCtrl::SendVehicleInfo(/*int & send_id, long mtype */
-                              ProtocolType type, const char *key,
+                              ProtocolType type, VehicleInfoKey key,
                               double data[], int len)
 {
-    return sendVehicleInfo( /*send_id, mtype, */ type, key, (void *) data,
-                           sizeof(double), len);
+    return sendVehicleInfo( /*send_id, mtype, */ type, m_viKey[key],
+                           (void *) data, sizeof(double), len);
 }
 
 bool CGtCtrl::SendVehicleInfo( /*int & send_id, long mtype, */
-                              ProtocolType type, const char *key, char data[],
-                              int len)
+                              ProtocolType type, VehicleInfoKey key,
+                              char data[], int len)
+{
+    return sendVehicleInfo( /*send_id, mtype, */ type, m_viKey[key],
+                           (void *) data, sizeof(char), len);
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   send vehicle information of one vehicle of the fleet
+ *
+ * @param[in]   vehicle     vehicle number
+ * @param[in]   key         vehicle information
+ * @param[in]   data        value of vehicle information
+ * @param[in]   len         length of vehicle information
+ * @return  bool    true:success,false:fail
+ */
+/*--------------------------------------------------------------------------*/
+bool CGtCtrl::SendFleetInfo(int vehicle, VehicleInfoKey key, int data)
+{
+    return sendVehicleInfo(dataport_def, m_viKey[key], (void *) &data,
+                           sizeof(int), 1, vehicle);
+}
+
+bool CGtCtrl::SendFleetInfo(int vehicle, VehicleInfoKey key, double data[],
+                            int len)
 {
-    return sendVehicleInfo( /*send_id, mtype, */ type, key, (void *) data,
-                           sizeof(char), len);
+    return sendVehicleInfo(dataport_def, m_viKey[key], (void *) data,
+                           sizeof(double), len, vehicle);
 }
 
 /*--------------------------------------------------------------------------*/
@@ -965,12 +1613,70 @@ void CGtCtrl::SetMQKeyData(char *buf, unsigned int bufsize, long &mtype,
                            const char *key, char status[], unsigned int size)
 {
     KeyDataMsg_t *tmp_t = (KeyDataMsg_t *) buf;
+    unsigned int used = offsetof(KeyDataMsg_t, data.status) + size;
+    if (bufsize < used) {
+        return;
+    }
 
-    memset(buf, 0x00, bufsize);
-    strcpy(tmp_t->KeyEventType, key);
-    gettimeofday(&tmp_t->recordtime, NULL);
+    strncpy(tmp_t->KeyEventType, key, sizeof(tmp_t->KeyEventType));
+    tmp_t->KeyEventType[sizeof(tmp_t->KeyEventType) - 1] = '\0';
+    if (m_bBatch) {
+        /* records of one frame share the time of their tick */
+        tmp_t->recordtime = m_tvTick;
+    }
+    else {
+        m_clock.GetTimeOfDay(&tmp_t->recordtime);
+    }
     tmp_t->data.common_status = 0;
     memcpy(&tmp_t->data.status[0], &status[0], size);
+    /* the message is sizeof(KeyDataMsg_t) + size, clear the tail padding */
+    memset(&buf[used], 0, bufsize - used);
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   time of compact format message
+ *          if the offset does not fit in 32bit any more (about 71 minutes
+ *          after the base time), a new name table restarts the base time.
+ *          must be called before reserve(), send() reuses the buffer.
+ *
+ * @param[in]   type    connection, selects the base time
+ * @return  uint32_t    micro sec since the base time of the connection
+ */
+/*--------------------------------------------------------------------------*/
+uint32_t CGtCtrl::GetCompactTime(ProtocolType type)
+{
+    struct timespec now;
+    m_clock.GetTime(&now);
+    int64_t usec = (int64_t) (now.tv_sec - m_tsBase[type].tv_sec) * 1000000 +
+        (now.tv_nsec - m_tsBase[type].tv_nsec) / 1000;
+    if (usec > (int64_t) 0xFFFFFFFF) {
+        SendNameTable(type);
+        usec = 0;
+    }
+    return (uint32_t) usec;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   vehicle information in compact format
+ *
+ * @param[in]   buf     buffer, sizeof(KeyDataCompact_t) + size bytes
+ * @param[in]   id      id of vehicle information in the name table
+ * @param[in]   usec    time returned by GetCompactTime()
+ * @param[in]   status  value of vehicle information
+ * @param[in]   size    size of status
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CGtCtrl::SetCompactKeyData(char *buf, int id, uint32_t usec,
+                                char status[], unsigned int size)
+{
+    KeyDataCompact_t *tmp_t = (KeyDataCompact_t *) buf;
+    memcpy(tmp_t->magic, KEYDATA_COMPACT_MAGIC, sizeof(tmp_t->magic));
+    tmp_t->id = (uint16_t) id;
+    tmp_t->usec = usec;
+    memcpy(&tmp_t->status[0], &status[0], size);
 }
 
 /*--------------------------------------------------------------------------*/
@@ -979,45 +1685,403 @@ void CGtCtrl::SetMQKeyData(char *buf, unsigned int bufsize, long &mtype,
  *
  * @param[in]   sendque_id  queue ID
  * @param[in]   priority    priority of queue
- * @param[in]   key         KeyEventType
+ * @param[in]   id          handle of VehicleInfoNameList
  * @param[in]   data        value of vehicle info
  * @param[in]   unit_size   size of send data unit
  * @param[in]   unit_cnt    number of send data unit
+ * @param[in]   vehicle     vehicle number of the fleet, -1: no fleet tag
  * @return  bool    true:success,false:failure
  */
 /*--------------------------------------------------------------------------*/
 bool CGtCtrl::sendVehicleInfo( /*int & send_id, long priority, */ 
-                              ProtocolType type, const char *key, void *data,
-                              unsigned int unit_size, int unit_cnt)
+                              ProtocolType type, int id, void *data,
+                              unsigned int unit_size, int unit_cnt,
+                              int vehicle)
 {
-    long priority = 1;
+    const char *key = m_viList.getName(id);
+    if (unit_size == 0 || unit_cnt <= 0 || data == NULL || key == NULL)
+        return false;
+
+    unsigned int datasize = unit_size * unit_cnt;
+
+    /**
+     * last value of every key, pushed again after a reconnect
+     */
+    if ((vehicle < 0) && (id < (int) m_snapshot[type].size()) &&
+        (datasize <= D_SCHED_MAXDATA)) {
+        SchedRecord &snap = m_snapshot[type][id];
+        snap.id = id;
+        snap.size = (int) datasize;
+        memcpy(snap.data, data, datasize);
+    }
+    if (!m_websocket_client[type].isConnected()) {
+        return false;
+    }
 
-    if (unit_size == 0 || unit_cnt <= 0 || data == NULL)
+    /**
+     * written in priority order by FlushVehicleInfo(), fleet records
+     * and oversized data go out directly
+     */
+    if ((vehicle < 0) &&
+        m_sched.Stage(type, GetSendLevel(id), id, data, (int) datasize)) {
+        m_sentKey.set(id);
+        return true;
+    }
+    if (!writeVehicleInfo(type, id, data, datasize, vehicle)) {
         return false;
+    }
+    m_sentKey.set(id);
+    return true;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   write vehicle information to the connection now
+ *
+ * @param[in]   type        connection
+ * @param[in]   id          handle of VehicleInfoNameList
+ * @param[in]   data        status bytes
+ * @param[in]   datasize    size of data
+ * @param[in]   vehicle     vehicle number of the fleet, -1: no fleet tag
+ * @return  bool    true:success,false:failure
+ */
+/*--------------------------------------------------------------------------*/
+bool CGtCtrl::writeVehicleInfo(ProtocolType type, int id, const void *data,
+                               unsigned int datasize, int vehicle)
+{
+    long priority = m_viList.getPriority(id);
+    const char *key = m_viList.getName(id);
+
+    if (!m_websocket_client[type].isConnected()) {
+        return false;           /* resynced after reconnect */
+    }
+
+    bool compact = (m_bCompact && m_bCompactAck[type]);
 
-    char adata[unit_size * unit_cnt];
-    char mqMsg[sizeof(KeyDataMsg_t) + sizeof(adata)];
+    /**
+     * build the message directly in the websocket send buffer
+     */
+    unsigned int msgsize;
+    uint32_t usec = 0;
+    if (compact) {
+        usec = GetCompactTime(type);
+        msgsize = sizeof(KeyDataCompact_t) + datasize;
+    }
+    else {
+        msgsize = sizeof(KeyDataMsg_t) + datasize;
+    }
+    unsigned int hdrsize = (vehicle >= 0) ? sizeof(KeyDataFleetHdr_t) : 0;
+    msgsize += hdrsize;
+    char *mqMsg = m_websocket_client[type].reserve(msgsize);
+    if (mqMsg == NULL) {
+        std::cerr << "Failed to reserve send buffer." << std::endl;
+        return false;
+    }
 
-    for (int i = 0; i < unit_cnt; i++) {
-        int pos = i * unit_size;
-        memcpy(&adata[pos], (char *) data + pos, unit_size);
+    if (vehicle >= 0) {
+        KeyDataFleetHdr_t *hdr = (KeyDataFleetHdr_t *) mqMsg;
+        memcpy(hdr->magic, KEYDATA_FLEET_MAGIC, sizeof(hdr->magic));
+        hdr->reserved = 0;
+        hdr->vehicle = (uint32_t) vehicle;
+        mqMsg += hdrsize;
     }
 
-    SetMQKeyData(&mqMsg[0], sizeof(mqMsg), priority, key, adata,
-                 sizeof(adata));
+    if (compact) {
+        SetCompactKeyData(mqMsg, id, usec, (char *) data, datasize);
+    }
+    else {
+        SetMQKeyData(mqMsg, msgsize - hdrsize, priority, key, (char *) data,
+                     datasize);
+    }
 
-    if (!m_websocket_client[type].
-        send(reinterpret_cast < char *>(mqMsg), sizeof(mqMsg)))
+    /* a value still queued for a slow AMB is replaced, latest wins */
+    if (!m_websocket_client[type].commit(msgsize, (vehicle < 0) ? id : -1))
     {
         std::cerr << "Failed to send data(" << errno << ")." << std::endl;
         return false;
     }
 
-    m_sendMsgInfo.push_back(string(key));
+    if ((!m_bFirstVelocity) && (id == m_viKey[VI_VELOCITY])) {
+        m_bFirstVelocity = true;
+        printf("startup: first VELOCITY sent in %.1fms\n", StartupTime());
+    }
+
+    return true;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   time since the start of Initialize()
+ *
+ * @return  double  [ms]
+ */
+/*--------------------------------------------------------------------------*/
+double CGtCtrl::StartupTime() const
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - m_tsStart.tv_sec) * 1000.0 +
+        (double) (now.tv_nsec - m_tsStart.tv_nsec) / 1000000.0;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   write a record staged by the send scheduler
+ *
+ * @param[in]   conn    connection
+ * @param[in]   rec     staged record
+ * @param[in]   arg     CGtCtrl
+ * @return  bool    true:success,false:failure
+ */
+/*--------------------------------------------------------------------------*/
+bool CGtCtrl::sched_writer(int conn, const SchedRecord *rec, void *arg)
+{
+    CGtCtrl *p = reinterpret_cast < CGtCtrl * >(arg);
+    return p->writeVehicleInfo((ProtocolType) conn, rec->id, rec->data,
+                               (unsigned int) rec->size, -1);
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   scheduler level of vehicle information
+ *
+ * @param[in]   id      handle of VehicleInfoNameList
+ * @return  int     0(most urgent) .. D_SCHED_LEVELS - 1
+ */
+/*--------------------------------------------------------------------------*/
+int CGtCtrl::GetSendLevel(int id) const
+{
+    long priority = m_viList.getPriority(id);
+    if (0 >= priority) {
+        priority = D_SEND_PRIORITY_DEFAULT;
+    }
+    if (D_SEND_PRIORITY_MAX < priority) {
+        priority = D_SEND_PRIORITY_MAX;
+    }
+    return (int) priority - 1;
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   write vehicle information staged since the previous flush,
+ *          most urgent first. deferrable records wait while the socket
+ *          is congested. in batch mode one frame per connection.
+ *
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CGtCtrl::FlushVehicleInfo()
+{
+    for (int i = 0; i < 4; i++) {
+        bool congested = ((0 < m_websocket_client[i].sendqDepth()) ||
+                          (D_SEND_CONGESTED < m_websocket_client[i].outq()));
+        m_sched.Flush(i, congested, CGtCtrl::sched_writer, this);
+    }
+    if (!m_bBatch) {
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (!m_websocket_client[i].flush()) {
+            std::cerr << "Failed to send batch(" << errno << ")."
+                      << std::endl;
+        }
+    }
+}
+
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   supervise the AMB connections: a lost connection is retried
+ *          with exponential backoff, after it is established again the
+ *          name table(compact format) and the last value of every key
+ *          are sent, so subscribers do not wait for the next change
+ *
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CGtCtrl::SuperviseConnections()
+{
+    struct timespec now;
+    bool now_valid = false;
+    for (int i = 0; i < 4; i++) {
+        WebsocketIF &ws = m_websocket_client[i];
+        bool up = ws.isConnected();
+        if (up && m_bConnUp[i]) {
+            continue;
+        }
+        if (!now_valid) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            now_valid = true;
+        }
+        if (up) {
+            if (0 == ws.disconnectCount()) {
+                printf("websocket port %d connected in %.1fms\n",
+                       m_websocket_port[i], ws.firstConnectTime());
+            }
+            else {
+                printf("websocket port %d reconnected in %.1fms\n",
+                       m_websocket_port[i], ws.lastRecoverTime());
+            }
+            m_bConnUp[i] = true;
+            m_nRetryMs[i] = D_WS_RECONNECT_MIN;
+            if (m_bCompact) {
+                m_bCompactAck[i] = false;
+                SendNameTable((ProtocolType) i);
+            }
+            SendSnapshot((ProtocolType) i);
+            continue;
+        }
+        if (m_bConnUp[i]) {
+            printf("websocket port %d disconnected\n", m_websocket_port[i]);
+            m_bConnUp[i] = false;
+            m_nRetryMs[i] = D_WS_RECONNECT_MIN;
+            m_tsRetry[i] = now;
+        }
+        if ((now.tv_sec < m_tsRetry[i].tv_sec) ||
+            ((now.tv_sec == m_tsRetry[i].tv_sec) &&
+             (now.tv_nsec < m_tsRetry[i].tv_nsec))) {
+            continue;
+        }
+        ws.reconnect();
+        long nsec = now.tv_nsec + (long) m_nRetryMs[i] * 1000000L;
+        m_tsRetry[i].tv_sec = now.tv_sec + nsec / 1000000000L;
+        m_tsRetry[i].tv_nsec = nsec % 1000000000L;
+        m_nRetryMs[i] *= 2;
+        if (D_WS_RECONNECT_MAX < m_nRetryMs[i]) {
+            m_nRetryMs[i] = D_WS_RECONNECT_MAX;
+        }
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   send the last value of every key sent on a connection,
+ *          written in priority order by the next FlushVehicleInfo()
+ *
+ * @param[in]   type    connection
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CGtCtrl::SendSnapshot(ProtocolType type)
+{
+    std::vector<SchedRecord> &snap = m_snapshot[type];
+    for (size_t id = 0; id < snap.size(); id++) {
+        if (0 > snap[id].size) {
+            continue;
+        }
+        if (!m_sched.Stage(type, GetSendLevel(snap[id].id), snap[id].id,
+                           snap[id].data, snap[id].size)) {
+            writeVehicleInfo(type, snap[id].id, snap[id].data,
+                             (unsigned int) snap[id].size, -1);
+        }
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   print queue depth metrics of the send scheduler
+ *
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CGtCtrl::PrintSendStats()
+{
+    for (int level = 0; level < D_SCHED_LEVELS; level++) {
+        printf("send: priority=%d sent=%lu depth=%d maxdepth=%d "
+               "deferred=%lu coalesced=%lu\n", level + 1,
+               m_sched.GetSentCount(level), m_sched.GetDepth(level),
+               m_sched.GetMaxDepth(level), m_sched.GetDeferCount(level),
+               m_sched.GetCoalesceCount(level));
+    }
+    for (int i = 0; i < 4; i++) {
+        printf("send: port=%d queued=%d maxqueued=%d coalesced=%lu "
+               "dropped=%lu\n", m_websocket_port[i],
+               m_websocket_client[i].sendqDepth(),
+               m_websocket_client[i].sendqMaxDepth(),
+               m_websocket_client[i].coalesceCount(),
+               m_websocket_client[i].dropCount());
+        printf("conn: port=%d connects=%lu disconnects=%lu "
+               "recover=%.1fms maxrecover=%.1fms\n", m_websocket_port[i],
+               m_websocket_client[i].connectCount(),
+               m_websocket_client[i].disconnectCount(),
+               m_websocket_client[i].lastRecoverTime(),
+               m_websocket_client[i].maxRecoverTime());
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   send id table of vehicle information names (compact format)
+ *          and restart the time base of the connection
+ *
+ * @param[in]   type    connection
+ * @return  bool    true:success,false:failure
+ */
+/*--------------------------------------------------------------------------*/
+bool CGtCtrl::SendNameTable(ProtocolType type)
+{
+    int size = KEYDATA_TABLE_HDRSIZE;
+    uint32_t count = 0;
+    for (int id = 0; id < m_viList.length(); id++) {
+        size += 3 + strlen(m_viList.getName(id));
+        count++;
+    }
+
+    std::vector<char> tbl(size);
+    struct timeval tv;
+    m_clock.GetTimeOfDay(&tv);
+    m_clock.GetTime(&m_tsBase[type]);
+    int64_t sec = tv.tv_sec;
+    int64_t usec = tv.tv_usec;
+    memcpy(&tbl[0], KEYDATA_TABLE_MAGIC, 4);
+    memcpy(&tbl[4], &count, sizeof(count));
+    memcpy(&tbl[8], &sec, sizeof(sec));
+    memcpy(&tbl[16], &usec, sizeof(usec));
+
+    int pos = KEYDATA_TABLE_HDRSIZE;
+    for (int id = 0; id < m_viList.length(); id++) {
+        const char *name = m_viList.getName(id);
+        uint16_t tid = (uint16_t) id;
+        unsigned char len = (unsigned char) strlen(name);
+        memcpy(&tbl[pos], &tid, sizeof(tid));
+        tbl[pos + 2] = (char) len;
+        memcpy(&tbl[pos + 3], name, len);
+        pos += 3 + len;
+    }
 
+    if (!m_websocket_client[type].send(&tbl[0], size)) {
+        std::cerr << "Failed to send name table(" << errno << ")."
+                  << std::endl;
+        return false;
+    }
     return true;
 }
 
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   drain messages received from AMB
+ *          (acknowledge of the name table switches to compact format)
+ *
+ * @return  none
+ */
+/*--------------------------------------------------------------------------*/
+void CGtCtrl::CheckRecvMessage()
+{
+    if (!m_bCompact) {
+        return;
+    }
+    char buf[WebsocketRecvQueue::maxdatasize];
+    for (int i = 0; i < 4; i++) {
+        memset(buf, 0x00, 4);
+        while (m_websocket_client[i].recv(buf, false)) {
+            if ((!m_bCompactAck[i]) && KeyDataIsAck(buf, 4)) {
+                printf("Websocket[%d] compact format\n", i);
+                m_bCompactAck[i] = true;
+            }
+            memset(buf, 0x00, 4);
+        }
+    }
+}
 
 /*--------------------------------------------------------------------------*/
 /**
@@ -1213,11 +2277,11 @@ bool CGtCtrl::LoadConfigJsonCarSim(JsonReader *reader)
                     return false;
                 }
                 g_assert(json_reader_is_array(reader));
-                m_viList.length = json_reader_count_elements(reader);
-                for (int j = 0; j < m_viList.length; j++) {
+                int count = json_reader_count_elements(reader);
+                for (int j = 0; j < count; j++) {
                     json_reader_read_element(reader, j);
                     std::string str = json_reader_get_string_value(reader);
-                    strcpy(m_viList.name[j], str.c_str());
+                    m_viList.add(str.c_str());
                     json_reader_end_element(reader);
                 }
                 json_reader_end_member(reader);
@@ -1296,6 +2360,10 @@ bool CGtCtrl::LoadConfigJsonCommon(JsonReader *reader)
                             m_viList.setPriority(str.c_str(), priority);
                         }
                     }
+                    PublishRule rule;
+                    if (GetConfigPublishRule(reader, &rule)) {
+                        m_policy.SetRule(str.c_str(), rule);
+                    }
                 }
                 json_reader_end_element(reader);
             }
@@ -1471,6 +2539,41 @@ bool CGtCtrl::GetConfigValBool(JsonReader *r, const char *key, bool *buf)
     return true;
 }
 
+/*--------------------------------------------------------------------------*/
+/**
+ * @brief   get publish rule of a VehicleInfoDefine entry, all members
+ *          are optional: "Deadband", "MinInterval"[ms], "MaxInterval"[ms]
+ *
+ * @param[in]   r       JsonReader object
+ * @param[out]  rule    publish rule
+ * @return  bool    false:no member of the rule
+ */
+/*--------------------------------------------------------------------------*/
+bool CGtCtrl::GetConfigPublishRule(JsonReader *r, PublishRule *rule)
+{
+    bool found = false;
+
+    rule->deadband = 0.0;
+    rule->minInterval = 0;
+    rule->maxInterval = 0;
+    if (json_reader_read_member(r, "Deadband")) {
+        rule->deadband = json_reader_get_double_value(r);
+        found = true;
+    }
+    json_reader_end_member(r);
+    if (json_reader_read_member(r, "MinInterval")) {
+        rule->minInterval = (int) json_reader_get_int_value(r);
+        found = true;
+    }
+    json_reader_end_member(r);
+    if (json_reader_read_member(r, "MaxInterval")) {
+        rule->maxInterval = (int) json_reader_get_int_value(r);
+        found = true;
+    }
+    json_reader_end_member(r);
+    return found;
+}
+
 /*--------------------------------------------------------------------------*/
 /**
  * @brief   get value form configuration file
@@ -1518,11 +2621,8 @@ void CGtCtrl::CheckSendResult(int mqid)
         }
         else {
             // ERROR
-            list < string >::iterator pos;
-            pos =
-                find(m_sendMsgInfo.begin(), m_sendMsgInfo.end(),
-                     string(ret.KeyEventType));
-            if (pos != m_sendMsgInfo.end()) {
+            ret.KeyEventType[sizeof(ret.KeyEventType) - 1] = '\0';
+            if (m_sentKey.isSent(m_viList.getId(ret.KeyEventType))) {
                 printf("send error: AMB cannot receive %s\n",
                        ret.KeyEventType);
             }
@@ -1537,32 +2637,29 @@ static int callback_data_def(libwebsocket_context * context,
                              void *user, void *in, size_t len)
 {
     switch (reason) {
-    case LWS_CALLBACK_CLIENT_RECEIVE:{
-            if (pthread_mutex_lock(&m_websocket_mutex[dataport_def]) != 0) {
-                std::cerr << "Failed to lock mutex" << std::endl;
-            }
-            char recvDataMsgBuf[sizeof(KeyDataMsg_t) + MsgQueueMaxMsgSize];
-            memset(&recvDataMsgBuf, 0, sizeof(recvDataMsgBuf));
-            memcpy(&recvDataMsgBuf, reinterpret_cast < char *>(in), len);
-            m_websocket_queue[dataport_def].push((&recvDataMsgBuf[0]),
-                                                 sizeof(recvDataMsgBuf));
-            pthread_cond_signal(&m_websocket_cond[dataport_def]);
-            if (pthread_mutex_unlock(&m_websocket_mutex[dataport_def]) != 0) {
-                std::cerr << "Failed to unlock mutex" << std::endl;
-            }
-            break;
-        }
+    case LWS_CALLBACK_CLIENT_RECEIVE:
+        /* lock-free, the consumer is woken by the queue eventfd */
+        m_websocket_queue[dataport_def].push(reinterpret_cast < char *>(in),
+                                             (int) len);
+        break;
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
-        if (pthread_mutex_lock(&m_websocket_mutex[dataport_def]) != 0) {
-            std::cerr << "Failed to lock mutex" << std::endl;
-        }
-        if (pthread_cond_signal(&m_websocket_cond[dataport_def]) != 0) {
-            std::cerr << "Failed to issue cond_signal" << std::endl;
-        }
-        if (pthread_mutex_unlock(&m_websocket_mutex[dataport_def]) != 0) {
-            std::cerr << "Failed to unlock mutex" << std::endl;
+        if (!WebsocketIF::established(context, wsi)) {
+            return -1;          /* abandoned attempt, close it */
         }
         break;
+    case LWS_CALLBACK_CLOSED:
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+        WebsocketIF::closed(context, wsi);
+        break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+        WebsocketIF::writeable(context, wsi);
+        break;
+    case LWS_CALLBACK_ADD_POLL_FD:
+    case LWS_CALLBACK_DEL_POLL_FD:
+    case LWS_CALLBACK_SET_MODE_POLL_FD:
+    case LWS_CALLBACK_CLEAR_MODE_POLL_FD:
+        WebsocketIF::pollfd(context, reason, user, len);
+        break;
     default:
         break;
     }
@@ -1575,32 +2672,29 @@ static int callback_ctrl_def(libwebsocket_context * context,
                              void *user, void *in, size_t len)
 {
     switch (reason) {
-    case LWS_CALLBACK_CLIENT_RECEIVE:{
-            if (pthread_mutex_lock(&m_websocket_mutex[ctrlport_def]) != 0) {
-                std::cerr << "Failed to lock mutex" << std::endl;
-            }
-            char recvDataMsgBuf[sizeof(KeyDataMsg_t) + MsgQueueMaxMsgSize];
-            memset(&recvDataMsgBuf, 0, sizeof(recvDataMsgBuf));
-            memcpy(&recvDataMsgBuf, reinterpret_cast < char *>(in), len);
-            m_websocket_queue[ctrlport_def].push((&recvDataMsgBuf[0]),
-                                                 sizeof(recvDataMsgBuf));
-            pthread_cond_signal(&m_websocket_cond[ctrlport_def]);
-            if (pthread_mutex_unlock(&m_websocket_mutex[ctrlport_def]) != 0) {
-                std::cerr << "Failed to unlock mutex" << std::endl;
-            }
-            break;
-        }
+    case LWS_CALLBACK_CLIENT_RECEIVE:
+        /* lock-free, the consumer is woken by the queue eventfd */
+        m_websocket_queue[ctrlport_def].push(reinterpret_cast < char *>(in),
+                                             (int) len);
+        break;
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
-        if (pthread_mutex_lock(&m_websocket_mutex[ctrlport_def]) != 0) {
-            std::cerr << "Failed to lock mutex" << std::endl;
-        }
-        if (pthread_cond_signal(&m_websocket_cond[ctrlport_def]) != 0) {
-            std::cerr << "Failed to issue cond_signal" << std::endl;
-        }
-        if (pthread_mutex_unlock(&m_websocket_mutex[ctrlport_def]) != 0) {
-            std::cerr << "Failed to unlock mutex" << std::endl;
+        if (!WebsocketIF::established(context, wsi)) {
+            return -1;          /* abandoned attempt, close it */
         }
         break;
+    case LWS_CALLBACK_CLOSED:
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+        WebsocketIF::closed(context, wsi);
+        break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+        WebsocketIF::writeable(context, wsi);
+        break;
+    case LWS_CALLBACK_ADD_POLL_FD:
+    case LWS_CALLBACK_DEL_POLL_FD:
+    case LWS_CALLBACK_SET_MODE_POLL_FD:
+    case LWS_CALLBACK_CLEAR_MODE_POLL_FD:
+        WebsocketIF::pollfd(context, reason, user, len);
+        break;
     default:
         break;
     }
@@ -1613,32 +2707,29 @@ static int callback_data_cust(libwebsocket_context * context,
                               void *user, void *in, size_t len)
 {
     switch (reason) {
-    case LWS_CALLBACK_CLIENT_RECEIVE:{
-            if (pthread_mutex_lock(&m_websocket_mutex[dataport_cust]) != 0) {
-                std::cerr << "Failed to lock mutex" << std::endl;
-            }
-            char recvDataMsgBuf[sizeof(KeyDataMsg_t) + MsgQueueMaxMsgSize];
-            memset(&recvDataMsgBuf, 0, sizeof(recvDataMsgBuf));
-            memcpy(&recvDataMsgBuf, reinterpret_cast < char *>(in), len);
-            m_websocket_queue[dataport_cust].push((&recvDataMsgBuf[0]),
-                                                  sizeof(recvDataMsgBuf));
-            pthread_cond_signal(&m_websocket_cond[dataport_cust]);
-            if (pthread_mutex_unlock(&m_websocket_mutex[dataport_cust]) != 0) {
-                std::cerr << "Failed to unlock mutex" << std::endl;
-            }
-            break;
-        }
+    case LWS_CALLBACK_CLIENT_RECEIVE:
+        /* lock-free, the consumer is woken by the queue eventfd */
+        m_websocket_queue[dataport_cust].push(reinterpret_cast < char *>(in),
+                                              (int) len);
+        break;
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
-        if (pthread_mutex_lock(&m_websocket_mutex[dataport_cust]) != 0) {
-            std::cerr << "Failed to lock mutex" << std::endl;
-        }
-        if (pthread_cond_signal(&m_websocket_cond[dataport_cust]) != 0) {
-            std::cerr << "Failed to issue cond_signal" << std::endl;
-        }
-        if (pthread_mutex_unlock(&m_websocket_mutex[dataport_cust]) != 0) {
-            std::cerr << "Failed to unlock mutex" << std::endl;
+        if (!WebsocketIF::established(context, wsi)) {
+            return -1;          /* abandoned attempt, close it */
         }
         break;
+    case LWS_CALLBACK_CLOSED:
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+        WebsocketIF::closed(context, wsi);
+        break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+        WebsocketIF::writeable(context, wsi);
+        break;
+    case LWS_CALLBACK_ADD_POLL_FD:
+    case LWS_CALLBACK_DEL_POLL_FD:
+    case LWS_CALLBACK_SET_MODE_POLL_FD:
+    case LWS_CALLBACK_CLEAR_MODE_POLL_FD:
+        WebsocketIF::pollfd(context, reason, user, len);
+        break;
     default:
         break;
     }
@@ -1651,32 +2742,29 @@ static int callback_ctrl_cust(libwebsocket_context * context,
                               void *user, void *in, size_t len)
 {
     switch (reason) {
-    case LWS_CALLBACK_CLIENT_RECEIVE:{
-            if (pthread_mutex_lock(&m_websocket_mutex[ctrlport_cust]) != 0) {
-                std::cerr << "Failed to lock mutex" << std::endl;
-            }
-            char recvDataMsgBuf[sizeof(KeyDataMsg_t) + MsgQueueMaxMsgSize];
-            memset(&recvDataMsgBuf, 0, sizeof(recvDataMsgBuf));
-            memcpy(&recvDataMsgBuf, reinterpret_cast < char *>(in), len);
-            m_websocket_queue[ctrlport_cust].push((&recvDataMsgBuf[0]),
-                                                  sizeof(recvDataMsgBuf));
-            pthread_cond_signal(&m_websocket_cond[ctrlport_cust]);
-            if (pthread_mutex_unlock(&m_websocket_mutex[ctrlport_cust]) != 0) {
-                std::cerr << "Failed to unlock mutex" << std::endl;
-            }
-            break;
-        }
+    case LWS_CALLBACK_CLIENT_RECEIVE:
+        /* lock-free, the consumer is woken by the queue eventfd */
+        m_websocket_queue[ctrlport_cust].push(reinterpret_cast < char *>(in),
+                                              (int) len);
+        break;
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
-        if (pthread_mutex_lock(&m_websocket_mutex[ctrlport_cust]) != 0) {
-            std::cerr << "Failed to lock mutex" << std::endl;
-        }
-        if (pthread_cond_signal(&m_websocket_cond[ctrlport_cust]) != 0) {
-            std::cerr << "Failed to issue cond_signal" << std::endl;
-        }
-        if (pthread_mutex_unlock(&m_websocket_mutex[ctrlport_cust]) != 0) {
-            std::cerr << "Failed to unlock mutex" << std::endl;
+        if (!WebsocketIF::established(context, wsi)) {
+            return -1;          /* abandoned attempt, close it */
         }
         break;
+    case LWS_CALLBACK_CLOSED:
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+        WebsocketIF::closed(context, wsi);
+        break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+        WebsocketIF::writeable(context, wsi);
+        break;
+    case LWS_CALLBACK_ADD_POLL_FD:
+    case LWS_CALLBACK_DEL_POLL_FD:
+    case LWS_CALLBACK_SET_MODE_POLL_FD:
+    case LWS_CALLBACK_CLEAR_MODE_POLL_FD:
+        WebsocketIF::pollfd(context, reason, user, len);
+        break;
     default:
         break;
     }
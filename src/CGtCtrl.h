@@ -20,6 +20,16 @@
 #include "CConf.h"
 #include "CJoyStick.h"
 #include "CJoyStickEV.h"
+#include "CTickTimer.h"
+#include "CEventLoop.h"
+#include "CCalc.h"
+#include "CFleet.h"
+#include "CSimClock.h"
+#include "CInputTrace.h"
+#include "CJoyStickReplay.h"
+#include "CJoyStickVirtual.h"
+#include "CPublishPolicy.h"
+#include "CSendScheduler.h"
 
 #include <pthread.h>
 
@@ -46,9 +56,9 @@
 #define MAX_SPEED   280
 #endif
 
-const useconds_t g_sleeptime = 10000; // = 10milli sec = 0.01 sec
-#define D_RUNLOOP_INTERVAL_COUNT  5
+#define D_RUNLOOP2_TICK_HZ        20    // Run2 vehicle update
 #define D_RUNLOOP_INTERVAL_COUNT2 50
+#define D_FLEET_SEED              1     // random inputs of fleet mode
 
 #define GEORESET 1000
 #define PIE 3.14159265
@@ -62,6 +72,24 @@ const useconds_t g_sleeptime = 10000; // = 10milli sec = 0.01 sec
 
 #define AMB_CONF        "/etc/ambd/config"
 
+/**
+ * send priority of vehicle information("Priority" of VehicleInfoDefine),
+ * 1 is the most urgent. from D_SEND_DEFER_PRIORITY on, records are held
+ * back and coalesced while the socket has more than D_SEND_CONGESTED
+ * bytes not sent yet.
+ */
+#define D_SEND_PRIORITY_MAX     D_SCHED_LEVELS
+#define D_SEND_PRIORITY_DEFAULT 2
+#define D_SEND_DEFER_PRIORITY   3
+#define D_SEND_CONGESTED        16384
+
+/**
+ * retry interval of a lost AMB connection [ms], doubled per failure
+ */
+#define D_WS_RECONNECT_MIN      100
+#define D_WS_RECONNECT_MAX      5000
+#define D_WS_CONNECT_POLL       10      // [ms] dispatch while connecting
+
 struct geoData
 {
     double lat;
@@ -80,15 +108,18 @@ void DaemonTerminate(int SigNo);
 void CloseAllSocket(void);
 
 
+/**
+ * names of vehicle information, interned once while the AMB config is
+ * loaded. an entry is addressed by its index (handle), which is also the
+ * id of the compact wire format. names are found through an open
+ * addressing hash table, lookups do not depend on the number of entries.
+ */
 struct VehicleInfoNameList
 {
-    const static int maxlen = 64;
+    const static int maxlen = 65536;        // id is 16bit in compact format
+    const static int maxnamelen = 63;       // KeyEventType of KeyDataMsg_t
 
   public:
-    int length;
-    char name[maxlen][64];
-    long priority[maxlen];
-
     /*--------------------------------------------------------------------------*/
     /**
      * @brief   initialize
@@ -99,29 +130,70 @@ struct VehicleInfoNameList
     /*--------------------------------------------------------------------------*/
     void init()
     {
-        length = 0;
-        memset(&name[0], 0x00, maxlen * 64);
-        memset(&priority[0], 0x00, sizeof(priority));
+        name.clear();
+        priority.clear();
+        slot.assign(16, -1);
     }
 
     /*--------------------------------------------------------------------------*/
     /**
-     * @brief   check to exist vehicle information name
+     * @brief   add vehicle information name
      *
      * @param[in]   s       name of vehicle information
-     * @return  bool    true:exist
+     * @return  int     handle. existing handle if already added,
+     *                  negative value if failure
      */
     /*--------------------------------------------------------------------------*/
-    bool isContainVehicleName(const char *s)
+    int add(const char *s)
     {
-        bool rtn = false;
+        int idx = 0;
 
         if (s == NULL)
-            return false;
-        if (getIdx(s) >= 0) {
-            rtn = true;
+            return -1;
+        if ((idx = getIdx(s)) >= 0)
+            return idx;
+        if ((int) strlen(s) > maxnamelen) {
+            printf("Too long vehicle information name: %s\n", s);
+            return -1;
+        }
+        if (length() >= maxlen) {
+            printf("Too many vehicle information: %s\n", s);
+            return -1;
+        }
+        if ((name.size() + 1) * 2 > slot.size()) {
+            rehash(slot.size() * 2);
         }
-        return rtn;
+        idx = length();
+        name.push_back(std::string(s));
+        priority.push_back(0);
+        insert(idx);
+        return idx;
+    }
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   number of vehicle information
+     *
+     * @param   none
+     * @return  int     number of element, handles are 0 .. length() - 1
+     */
+    /*--------------------------------------------------------------------------*/
+    int length() const
+    {
+        return (int) name.size();
+    }
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   check to exist vehicle information name
+     *
+     * @param[in]   s       name of vehicle information
+     * @return  bool    true:exist
+     */
+    /*--------------------------------------------------------------------------*/
+    bool isContainVehicleName(const char *s) const
+    {
+        return (getId(s) >= 0);
     }
 
     /*--------------------------------------------------------------------------*/
@@ -135,12 +207,13 @@ struct VehicleInfoNameList
     /*--------------------------------------------------------------------------*/
     void setPriority(const char *s, long p)
     {
-        int idx = 0;
+        setPriority(getId(s), p);
+    }
 
-        if (s == NULL)
-            return;
-        if ((idx = getIdx(s)) >= 0) {
-            priority[idx] = p;
+    void setPriority(int id, long p)
+    {
+        if ((id >= 0) && (id < length())) {
+            priority[id] = p;
         }
     }
 
@@ -152,21 +225,68 @@ struct VehicleInfoNameList
      * @return  int     priority. if negative value returned, failure
      */
     /*--------------------------------------------------------------------------*/
-    long getPriority(const char *s)
+    long getPriority(const char *s) const
     {
-        int idx = 0;
-        long rtn = 0;
+        return getPriority(getId(s));
+    }
 
-        if (s == NULL)
+    long getPriority(int id) const
+    {
+        if ((id < 0) || (id >= length()))
             return 0;
-        if ((idx = getIdx(s)) >= 0) {
-            rtn = priority[idx];
-        }
+        return priority[id];
+    }
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   get handle of vehicle information
+     *
+     * @param[in]   s   name of vehicle information
+     * @return  int     handle. if negative value returned, not in the list
+     */
+    /*--------------------------------------------------------------------------*/
+    int getId(const char *s) const
+    {
+        if (s == NULL)
+            return -1;
+        return getIdx(s);
+    }
 
-        return rtn;
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   get name of vehicle information by handle
+     *
+     * @param[in]   id  handle returned by add() or getId()
+     * @return  const char *    name. NULL if id is out of range
+     */
+    /*--------------------------------------------------------------------------*/
+    const char *getName(int id) const
+    {
+        if ((id < 0) || (id >= length()))
+            return NULL;
+        return name[id].c_str();
     }
 
   private:
+    std::vector<std::string> name;
+    std::vector<long> priority;
+    std::vector<int> slot;      // handle or -1(empty), size is power of 2
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   FNV-1a hash of name
+     */
+    /*--------------------------------------------------------------------------*/
+    static unsigned int hash(const char *s)
+    {
+        unsigned int h = 2166136261U;
+        for (; *s != '\0'; s++) {
+            h ^= (unsigned char) *s;
+            h *= 16777619U;
+        }
+        return h;
+    }
+
     /*--------------------------------------------------------------------------*/
     /**
      * @brief   get number of vehicle information list
@@ -175,18 +295,111 @@ struct VehicleInfoNameList
      * @return  int     number of element
      */
     /*--------------------------------------------------------------------------*/
-    int getIdx(const char *s)
+    int getIdx(const char *s) const
     {
-        int limit = length < maxlen ? length : maxlen;
-        int rtn = -1;
-        for (int i = 0; i < limit; i++) {
-            if (!strcmp(name[i], s)) {
-                rtn = i;
-                break;
+        if (slot.empty())
+            return -1;
+        unsigned int mask = slot.size() - 1;
+        /* at most half of the slots are used, the probe always ends */
+        for (unsigned int i = hash(s) & mask; slot[i] >= 0;
+             i = (i + 1) & mask) {
+            if (!strcmp(name[slot[i]].c_str(), s)) {
+                return slot[i];
             }
         }
-        return rtn;
+        return -1;
     }
+
+    void insert(int idx)
+    {
+        unsigned int mask = slot.size() - 1;
+        unsigned int i = hash(name[idx].c_str()) & mask;
+        while (slot[i] >= 0) {
+            i = (i + 1) & mask;
+        }
+        slot[i] = idx;
+    }
+
+    void rehash(size_t size)
+    {
+        slot.assign(size, -1);
+        for (int i = 0; i < length(); i++) {
+            insert(i);
+        }
+    }
+};
+
+
+/**
+ * vehicle information sent since the last clear(), indexed by handle of
+ * VehicleInfoNameList. clear() only advances the generation, so nothing
+ * is allocated or walked in the run loop after resize().
+ */
+struct SentKeyTracker
+{
+  public:
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   set number of handles, forget all sent keys
+     *
+     * @param[in]   n       number of vehicle information
+     * @return  none
+     */
+    /*--------------------------------------------------------------------------*/
+    void resize(int n)
+    {
+        gen.assign(n, 0);
+        current = 1;
+    }
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   forget all sent keys
+     *
+     * @param   none
+     * @return  none
+     */
+    /*--------------------------------------------------------------------------*/
+    void clear()
+    {
+        if (++current == 0) {
+            /* generation wrapped, old marks would match again */
+            std::fill(gen.begin(), gen.end(), 0);
+            current = 1;
+        }
+    }
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   mark vehicle information as sent
+     *
+     * @param[in]   id      handle of vehicle information
+     * @return  none
+     */
+    /*--------------------------------------------------------------------------*/
+    void set(int id)
+    {
+        if ((id >= 0) && (id < (int) gen.size())) {
+            gen[id] = current;
+        }
+    }
+
+    /*--------------------------------------------------------------------------*/
+    /**
+     * @brief   check vehicle information was sent since the last clear()
+     *
+     * @param[in]   id      handle of vehicle information
+     * @return  bool    true:sent
+     */
+    /*--------------------------------------------------------------------------*/
+    bool isSent(int id) const
+    {
+        return ((id >= 0) && (id < (int) gen.size()) && (gen[id] == current));
+    }
+
+  private:
+    std::vector<unsigned int> gen;      // generation of the last set()
+    unsigned int current;
 };
 
 
@@ -255,6 +468,25 @@ enum ProtocolType
     ctrlport_cust
 };
 
+/**
+ * vehicle information sent by carsim
+ * (CGtCtrl::m_viKey holds their VehicleInfoNameList handles)
+ */
+enum VehicleInfoKey
+{
+    VI_LOCATION = 0,
+    VI_STEERING,
+    VI_TURN_SIGNAL,
+    VI_ENGINE_SPEED,
+    VI_ACCPEDAL_OPEN,
+    VI_BRAKE_SIGNAL,
+    VI_BRAKE_PRESSURE,
+    VI_VELOCITY,
+    VI_SHIFT,
+    VI_DIRECTION,
+    VI_KEY_MAX
+};
+
 class CGtCtrl
 {
   public:
@@ -268,41 +500,114 @@ class CGtCtrl
     bool Initialize();
     bool Terminate();
 
+    void SetFleet(int vehicles, int threads, const char *script);
+    void SetHeadless(double duration);
+    void SetRecord(const char *path);
+    bool SetReplay(const char *path, double speed);
+    void SetVirtualJoyStick(CJoyStickVirtual::SOURCE source,
+                            const char *path);
+
     void Run();
     void Run2();
+    void RunFleet();
     static void signal_handler(int signo);
+    static void js_handler(int fd, unsigned int events, void *arg);
+    static void tick_handler(int fd, unsigned int events, void *arg);
 
   private:
     int m_nJoyStickID;
 
     bool m_bFirstOpen;
 
+    CTickTimer m_tick;
+    CEventLoop m_loop;
+    bool m_bJsReady;
+    bool m_bTickReady;
+    JoyStickInput m_jsInput;
+
+    bool m_bBatch;
+    struct timeval m_tvTick;
+
+    CSimClock m_clock;
+    bool m_bHeadless;
+    double m_dSimDuration;      // headless: stop after [sec], 0: no limit
+    long m_nTickNsec;
+
+    CInputTrace m_trace;
+    std::string m_strRecord;    // trace file to record, empty: off
+    double m_dReplaySpeed;      // 1: real time, N: N times faster, 0: max
+    struct timespec m_tsReplayReal;     // real time of the replay start
+    struct timespec m_tsReplayTrace;    // trace time of the replay start
+
+    bool m_bCompact;
+    bool m_bCompactAck[4];
+    struct timespec m_tsBase[4];
+
     VehicleInfo m_stVehicleInfo;
 
+    bool m_bFastGeodesy;
+    GEORADII m_geoRadii;
+
+    CFleet m_fleet;
+    int m_nFleetSize;           // 0: single vehicle
+    int m_nFleetThreads;        // 0: number of CPUs
+    std::string m_strFleetScript;
+
     int m_websocket_port[4];
+    WebsocketTransport m_transport;     // context shared by the four
     WebsocketIF m_websocket_client[4];
+    bool m_bConnUp[4];          // connection state seen by supervision
+    int m_nRetryMs[4];          // current reconnect backoff
+    struct timespec m_tsRetry[4];       // next reconnect attempt
+    std::vector<SchedRecord> m_snapshot[4];     // last value per handle
+    struct timespec m_tsStart;  // start of Initialize(), startup times
+    bool m_bFirstVelocity;      // first VELOCITY written and logged
     KeyEventOptMsg_t m_msgOpt;
     KeyDataMsg_t m_msgDat;
 
     VehicleInfoNameList m_viList;
+    int m_viKey[VI_KEY_MAX];
 
-    std::list<std::string> m_sendMsgInfo;
+    SentKeyTracker m_sentKey;
+    CPublishPolicy m_policy;
+    CSendScheduler m_sched;
 
     bool LoadConfigJson(const char *);
     bool LoadConfigAMBJson(const char *, char *, int);
     bool LoadConfigJsonCommon(JsonReader *);
     bool LoadConfigJsonCarSim(JsonReader *);
     void DelJsonObj(JsonParser *, JsonReader *);
-    bool SendVehicleInfo(ProtocolType type, const char *key, bool data);
-    bool SendVehicleInfo(ProtocolType type, const char *key, int data);
-    bool SendVehicleInfo(ProtocolType type, const char *key, int data[],
-                         int len);
-    bool SendVehicleInfo(ProtocolType type, const char *key, double data[],
+    bool SendVehicleInfo(ProtocolType type, VehicleInfoKey key, bool data);
+    bool SendVehicleInfo(ProtocolType type, VehicleInfoKey key, int data);
+    bool SendVehicleInfo(ProtocolType type, VehicleInfoKey key, int data[],
                          int len);
-    bool SendVehicleInfo(ProtocolType type, const char *key, char data[],
+    bool SendVehicleInfo(ProtocolType type, VehicleInfoKey key,
+                         double data[], int len);
+    bool SendVehicleInfo(ProtocolType type, VehicleInfoKey key, char data[],
                          int len);
-    bool sendVehicleInfo(ProtocolType type, const char *key, void *data,
-                         unsigned int unit_size, int unit_cnt);
+    bool sendVehicleInfo(ProtocolType type, int id, void *data,
+                         unsigned int unit_size, int unit_cnt,
+                         int vehicle = -1);
+    bool writeVehicleInfo(ProtocolType type, int id, const void *data,
+                          unsigned int datasize, int vehicle);
+    static bool sched_writer(int conn, const SchedRecord *rec, void *arg);
+    int GetSendLevel(int id) const;
+    void PrintSendStats();
+    bool SendFleetInfo(int vehicle, VehicleInfoKey key, int data);
+    bool SendFleetInfo(int vehicle, VehicleInfoKey key, double data[],
+                       int len);
+    void FlushVehicleInfo();
+    void SuperviseConnections();
+    void SendSnapshot(ProtocolType type);
+    double StartupTime() const;
+    bool StartTick(int hz);
+    int IntervalCount(int tickHz) const;
+    bool DispatchTick();
+    void RecordTick();
+    bool ReplayTick();
+    void StopTick();
+    bool SendNameTable(ProtocolType type);
+    void CheckRecvMessage();
     bool GetConfigValue(JsonReader *, const char *, char *, int);
     bool GetConfigValue(JsonReader *, const char *, int *, int);
     bool GetConfigValue(JsonReader *, const char *, double *, int);
@@ -311,8 +616,12 @@ class CGtCtrl
     bool GetConfigValInt(JsonReader *, const char *, int *);
     bool GetConfigValDouble(JsonReader *, const char *, double *);
     bool GetConfigValBool(JsonReader *, const char *, bool *);
+    bool GetConfigPublishRule(JsonReader *, PublishRule *);
     void SetMQKeyData(char *buf, unsigned int bufsize, long &mtype,
                       const char *key, char status[], unsigned int size);
+    uint32_t GetCompactTime(ProtocolType type);
+    void SetCompactKeyData(char *buf, int id, uint32_t usec,
+                           char status[], unsigned int size);
     void CheckSendResult(int mqid);
 };
 
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Binary trace of the run loop inputs
+ * @file    CInputTrace.cpp
+ */
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include "CInputTrace.h"
+
+/**
+ * @brief CInputTrace
+ *        Constructor
+ */
+CInputTrace::CInputTrace()
+{
+    m_fp = NULL;
+    m_map = NULL;
+    m_size = 0;
+    m_posStep = 0;
+    m_posEnd = 0;
+    m_posJs = 0;
+    m_posRoute = 0;
+    m_tickHz = 0;
+    m_steps = 0;
+}
+
+/**
+ * @brief ~CInputTrace
+ *        destructor
+ */
+CInputTrace::~CInputTrace()
+{
+    Close();
+}
+
+/**
+ * @brief Create
+ *        start recording, an existing file is overwritten
+ * @param path trace file
+ * @param tickHz tick rate of the run loop
+ * @return true:success false:failure
+ */
+bool CInputTrace::Create(const char *path, int tickHz)
+{
+    Close();
+    m_fp = fopen(path, "wb");
+    if (NULL == m_fp) {
+        std::cerr << "Failed to create trace " << path << "(" << errno
+                  << ")." << std::endl;
+        return false;
+    }
+    char hdr[D_TRACE_HDRSIZE];
+    uint32_t version = D_TRACE_VERSION;
+    uint32_t hz = (uint32_t) tickHz;
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(&hdr[0], D_TRACE_MAGIC, 4);
+    memcpy(&hdr[4], &version, sizeof(version));
+    memcpy(&hdr[8], &hz, sizeof(hz));
+    if (1 != fwrite(hdr, sizeof(hdr), 1, m_fp)) {
+        Close();
+        return false;
+    }
+    m_tickHz = tickHz;
+    return true;
+}
+
+/**
+ * @brief WriteStep
+ *        start a new step, the previous step is flushed to the file
+ *        so a crash loses at most the current step
+ * @param flags D_TRACE_STEP_TICK / D_TRACE_STEP_JS
+ * @param ts monotonic time of the step
+ * @param tv wall clock time of the step
+ * @return true:success false:failure
+ */
+bool CInputTrace::WriteStep(unsigned int flags, const struct timespec *ts,
+                            const struct timeval *tv)
+{
+    if (NULL == m_fp) {
+        return false;
+    }
+    fflush(m_fp);
+    InputTraceStep s;
+    s.flags = flags;
+    s.step = (uint32_t) m_steps;
+    s.mono_sec = ts->tv_sec;
+    s.mono_nsec = ts->tv_nsec;
+    s.wall_sec = tv->tv_sec;
+    s.wall_usec = tv->tv_usec;
+    m_steps++;
+    return write(D_TRACE_STEP, &s, sizeof(s));
+}
+
+/**
+ * @brief WriteJs
+ *        joystick event taken in the current step
+ * @return true:success false:failure
+ */
+bool CInputTrace::WriteJs(int type, int number, int value)
+{
+    InputTraceJs js;
+    js.type = type;
+    js.number = number;
+    js.value = value;
+    js.reserved = 0;
+    return write(D_TRACE_JS, &js, sizeof(js));
+}
+
+/**
+ * @brief WriteRoute
+ *        route text taken in the current step, text longer than a record
+ *        is split into several, NextRoute() returns them in order
+ * @return true:success false:failure
+ */
+bool CInputTrace::WriteRoute(const char *text, int len)
+{
+    do {
+        int n = (0xFFFF < len) ? 0xFFFF : len;
+        if (!write(D_TRACE_ROUTE, text, n)) {
+            return false;
+        }
+        text += n;
+        len -= n;
+    } while (0 < len);
+    return true;
+}
+
+/**
+ * @brief write
+ *        append one record
+ * @param kind D_TRACE_STEP / D_TRACE_JS / D_TRACE_ROUTE
+ * @param data payload
+ * @param len size of payload
+ * @return true:success false:failure
+ */
+bool CInputTrace::write(int kind, const void *data, int len)
+{
+    if ((NULL == m_fp) || (0 > len) || (0xFFFF < len)) {
+        return false;
+    }
+    static const char pad[8] = { 0 };
+    char hdr[D_TRACE_RECHDRSIZE];
+    uint16_t k = (uint16_t) kind;
+    uint16_t n = (uint16_t) len;
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(&hdr[0], &k, sizeof(k));
+    memcpy(&hdr[2], &n, sizeof(n));
+    if (1 != fwrite(hdr, sizeof(hdr), 1, m_fp)) {
+        return false;
+    }
+    if ((0 < len) && (1 != fwrite(data, len, 1, m_fp))) {
+        return false;
+    }
+    int padlen = D_TRACE_ALIGN(len) - len;
+    if ((0 < padlen) && (1 != fwrite(pad, padlen, 1, m_fp))) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Open
+ *        map a trace for replay
+ * @param path trace file
+ * @return true:success false:failure
+ */
+bool CInputTrace::Open(const char *path)
+{
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (0 > fd) {
+        std::cerr << "Failed to open trace " << path << "(" << errno
+                  << ")." << std::endl;
+        return false;
+    }
+    struct stat st;
+    if ((0 > fstat(fd, &st)) || (D_TRACE_HDRSIZE > st.st_size)) {
+        std::cerr << "Invalid trace " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        std::cerr << "Failed to map trace " << path << "(" << errno
+                  << ")." << std::endl;
+        return false;
+    }
+    m_map = (char *) p;
+    m_size = st.st_size;
+
+    uint32_t version;
+    uint32_t hz;
+    memcpy(&version, &m_map[4], sizeof(version));
+    memcpy(&hz, &m_map[8], sizeof(hz));
+    if ((0 != memcmp(&m_map[0], D_TRACE_MAGIC, 4)) ||
+        (D_TRACE_VERSION != version) || (0 == hz)) {
+        std::cerr << "Invalid trace " << path << std::endl;
+        Close();
+        return false;
+    }
+    m_tickHz = (int) hz;
+    m_posStep = D_TRACE_HDRSIZE;
+    m_posEnd = D_TRACE_HDRSIZE;
+    m_posJs = D_TRACE_HDRSIZE;
+    m_posRoute = D_TRACE_HDRSIZE;
+    return true;
+}
+
+/**
+ * @brief NextStep
+ *        go to the next step, joystick events and route text of the
+ *        step are taken by NextJs() and NextRoute()
+ * @param flags D_TRACE_STEP_TICK / D_TRACE_STEP_JS
+ * @param ts monotonic time of the step
+ * @param tv wall clock time of the step
+ * @return true:success false:end of trace
+ */
+bool CInputTrace::NextStep(unsigned int *flags, struct timespec *ts,
+                           struct timeval *tv)
+{
+    const char *data;
+    int len;
+    size_t pos = m_posEnd;
+    if (!next(D_TRACE_STEP, &pos, &data, &len) ||
+        ((int) sizeof(InputTraceStep) > len)) {
+        return false;
+    }
+    InputTraceStep s;
+    memcpy(&s, data, sizeof(s));
+    *flags = s.flags;
+    ts->tv_sec = s.mono_sec;
+    ts->tv_nsec = s.mono_nsec;
+    tv->tv_sec = s.wall_sec;
+    tv->tv_usec = s.wall_usec;
+
+    /**
+     * the step lasts until the next step record
+     */
+    m_posStep = pos;
+    m_posEnd = pos;
+    while (m_posEnd + D_TRACE_RECHDRSIZE <= m_size) {
+        uint16_t k;
+        uint16_t n;
+        memcpy(&k, &m_map[m_posEnd], sizeof(k));
+        memcpy(&n, &m_map[m_posEnd + 2], sizeof(n));
+        if (D_TRACE_STEP == k) {
+            break;
+        }
+        m_posEnd += D_TRACE_RECHDRSIZE + D_TRACE_ALIGN(n);
+    }
+    if (m_posEnd > m_size) {
+        m_posEnd = m_size;      // truncated by a crash
+    }
+    m_posJs = m_posStep;
+    m_posRoute = m_posStep;
+    m_steps++;
+    return true;
+}
+
+/**
+ * @brief NextJs
+ *        next joystick event of the current step
+ * @return true:success false:no more events in this step
+ */
+bool CInputTrace::NextJs(int *type, int *number, int *value)
+{
+    const char *data;
+    int len;
+    if (!next(D_TRACE_JS, &m_posJs, &data, &len) ||
+        ((int) sizeof(InputTraceJs) > len)) {
+        return false;
+    }
+    InputTraceJs js;
+    memcpy(&js, data, sizeof(js));
+    *type = js.type;
+    *number = js.number;
+    *value = js.value;
+    return true;
+}
+
+/**
+ * @brief NextRoute
+ *        next route text of the current step, the text of a step may
+ *        come in several parts
+ * @param text route text, points into the mapped file
+ * @param len size of text
+ * @return true:success false:no more route text in this step
+ */
+bool CInputTrace::NextRoute(const char **text, int *len)
+{
+    return next(D_TRACE_ROUTE, &m_posRoute, text, len);
+}
+
+/**
+ * @brief next
+ *        find the next record of kind, a step record ends the search
+ *        unless kind is D_TRACE_STEP
+ * @param kind record kind
+ * @param pos in:search start out:behind the record found
+ * @param data payload
+ * @param len size of payload
+ * @return true:found false:not found
+ */
+bool CInputTrace::next(int kind, size_t *pos, const char **data, int *len)
+{
+    if (NULL == m_map) {
+        return false;
+    }
+    size_t p = *pos;
+    while (p + D_TRACE_RECHDRSIZE <= m_size) {
+        uint16_t k;
+        uint16_t n;
+        memcpy(&k, &m_map[p], sizeof(k));
+        memcpy(&n, &m_map[p + 2], sizeof(n));
+        if (p + D_TRACE_RECHDRSIZE + n > m_size) {
+            break;              // truncated by a crash
+        }
+        if ((D_TRACE_STEP == k) && (D_TRACE_STEP != kind)) {
+            break;
+        }
+        size_t body = p + D_TRACE_RECHDRSIZE;
+        p = body + D_TRACE_ALIGN(n);
+        if (kind == k) {
+            *data = &m_map[body];
+            *len = n;
+            *pos = p;
+            return true;
+        }
+    }
+    *pos = p;
+    return false;
+}
+
+/**
+ * @brief Close
+ *        finish recording or replay
+ */
+void CInputTrace::Close()
+{
+    if (NULL != m_fp) {
+        fclose(m_fp);
+        m_fp = NULL;
+    }
+    if (NULL != m_map) {
+        munmap(m_map, m_size);
+        m_map = NULL;
+    }
+    m_size = 0;
+    m_steps = 0;
+}
+
+/**
+ * End of File.(CInputTrace.cpp)
+ */
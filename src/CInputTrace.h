@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Binary trace of the run loop inputs
+ *          written append-only while driving, read back through mmap()
+ *          to replay the same drive.
+ *
+ *   header (32 byte)
+ *     0       4     magic "CST1"
+ *     4       4     version
+ *     8       4     tick rate [Hz] of the recorded run loop
+ *     12      4     reserved(0)
+ *     16      16    reserved(0)
+ *
+ *   records, each at a multiple of 8
+ *     0       2     kind (D_TRACE_STEP / D_TRACE_JS / D_TRACE_ROUTE)
+ *     2       2     size of the payload
+ *     4       4     reserved(0)
+ *     8       ...   payload, padded up to a multiple of 8
+ *
+ *   a step record starts every run loop pass that had work to do
+ *   (tick or joystick), the joystick events and route points taken in
+ *   that pass follow it. Integers are in host byte order.
+ *
+ * @file    CInputTrace.h
+ */
+
+#ifndef CINPUTTRACE_H_
+#define CINPUTTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define D_TRACE_MAGIC       "CST1"
+#define D_TRACE_VERSION     1
+#define D_TRACE_HDRSIZE     32
+#define D_TRACE_RECHDRSIZE  8
+#define D_TRACE_ALIGN(n)    (((n) + 7) & ~7)
+
+#define D_TRACE_STEP        1
+#define D_TRACE_JS          2
+#define D_TRACE_ROUTE       3
+
+#define D_TRACE_STEP_TICK   0x01    // tick timer expired
+#define D_TRACE_STEP_JS     0x02    // joystick was readable
+
+struct InputTraceStep
+{
+    uint32_t flags;
+    uint32_t step;
+    int64_t mono_sec;           // CLOCK_MONOTONIC
+    int64_t mono_nsec;
+    int64_t wall_sec;           // gettimeofday
+    int64_t wall_usec;
+};
+
+struct InputTraceJs
+{
+    int32_t type;
+    int32_t number;
+    int32_t value;
+    int32_t reserved;
+};
+
+class CInputTrace
+{
+  public:
+            CInputTrace();
+    virtual ~CInputTrace();
+
+    /* record */
+    bool    Create(const char *path, int tickHz);
+    bool    WriteStep(unsigned int flags, const struct timespec *ts,
+                      const struct timeval *tv);
+    bool    WriteJs(int type, int number, int value);
+    bool    WriteRoute(const char *text, int len);
+
+    /* replay */
+    bool    Open(const char *path);
+    bool    NextStep(unsigned int *flags, struct timespec *ts,
+                     struct timeval *tv);
+    bool    NextJs(int *type, int *number, int *value);
+    bool    NextRoute(const char **text, int *len);
+
+    void    Close();
+    bool    IsRecording() const;
+    bool    IsReplaying() const;
+    int     GetTickRate() const;
+    unsigned long GetStepCount() const;
+
+  private:
+    bool    write(int kind, const void *data, int len);
+    bool    next(int kind, size_t *pos, const char **data, int *len);
+
+    FILE   *m_fp;               // record
+    char   *m_map;              // replay
+    size_t  m_size;
+    size_t  m_posStep;          // next step record
+    size_t  m_posEnd;           // end of the current step
+    size_t  m_posJs;            // next joystick record of the current step
+    size_t  m_posRoute;         // next route record of the current step
+    int     m_tickHz;
+    unsigned long m_steps;
+};
+
+/**
+ * @brief IsRecording
+ * @return true:Create() succeeded
+ */
+inline bool CInputTrace::IsRecording() const
+{
+    return (NULL != m_fp);
+}
+
+/**
+ * @brief IsReplaying
+ * @return true:Open() succeeded
+ */
+inline bool CInputTrace::IsReplaying() const
+{
+    return (NULL != m_map);
+}
+
+/**
+ * @brief GetTickRate
+ * @return tick rate of the recorded run loop [Hz]
+ */
+inline int CInputTrace::GetTickRate() const
+{
+    return m_tickHz;
+}
+
+/**
+ * @brief GetStepCount
+ * @return steps written or read
+ */
+inline unsigned long CInputTrace::GetStepCount() const
+{
+    return m_steps;
+}
+
+#endif /* CINPUTTRACE_H_ */
+/**
+ * End of File.(CInputTrace.h)
+ */
@@ -22,9 +22,82 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <string.h>
+#include <errno.h>
 #include "CJoyStick.h"
+#include "CInputTrace.h"
 using namespace std;
 
+/**
+ * @brief clear coalesced input
+ */
+void JoyStickInput::clear()
+{
+    axisChanged = 0;
+    buttonChanged = 0;
+    memset(pressed, 0, sizeof(pressed));
+}
+
+/**
+ * @brief merge one event, recorded to trace if set
+ * @param[in]   type    JS_EVENT_AXIS / JS_EVENT_BUTTON
+ * @param[in]   number  number of button or axis
+ * @param[in]   value   value of input
+ */
+void JoyStickInput::set(int type, int number, int value)
+{
+    if (NULL != trace) {
+        trace->WriteJs(type, number, value);
+    }
+    if (0 > number) {
+        return;
+    }
+    if ((JS_EVENT_AXIS == type) && (D_JS_MAX_AXES > number)) {
+        axis[number] = value;
+        axisChanged |= (1u << number);
+    }
+    else if ((JS_EVENT_BUTTON == type) && (D_JS_MAX_BUTTONS > number)) {
+        button[number] = value;
+        buttonChanged |= (1u << number);
+        if ((0 != value) && (255 > pressed[number])) {
+            pressed[number]++;
+        }
+    }
+}
+
+/**
+ * @brief take out one coalesced event
+ *        changed axes first, then one event per button press,
+ *        then the release of changed buttons
+ * @retval true:event taken false:nothing left
+ */
+bool JoyStickInput::pop(int *type, int *number, int *value)
+{
+    if (0 != axisChanged) {
+        int i = __builtin_ctz(axisChanged);
+        axisChanged &= ~(1u << i);
+        *type = JS_EVENT_AXIS;
+        *number = i;
+        *value = axis[i];
+        return true;
+    }
+    while (0 != buttonChanged) {
+        int i = __builtin_ctz(buttonChanged);
+        *type = JS_EVENT_BUTTON;
+        *number = i;
+        if (0 < pressed[i]) {
+            pressed[i]--;
+            *value = 1;
+            return true;
+        }
+        buttonChanged &= ~(1u << i);
+        if (0 == button[i]) {
+            *value = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @breif constructor
  */
@@ -82,6 +155,14 @@ int CJoyStick::Open()
     return m_nJoyStickID;
 }
 
+/**
+ * @brief vehicle speed fed back to the input source, a device ignores it
+ * @param speed [km/h]
+ */
+void CJoyStick::SetFeedback(double /*speed*/)
+{
+}
+
 /**
  * @brief get axis count
  */
@@ -98,6 +179,15 @@ int CJoyStick::GetButtonsCount() const
     return (int) m_ucButtons;
 }
 
+/**
+ * @brief get device file descriptor
+ * @retval file descriptor, negative value if not opened
+ */
+int CJoyStick::GetFd() const
+{
+    return m_nJoyStickID;
+}
+
 /**
  * @brief joystick device file close
  * @retval 0:close success
@@ -151,6 +241,40 @@ int CJoyStick::Read(int *number, int *value)
     }
 }
 
+/**
+ * @brief read all queued events
+ *        the device is non-blocking, so read() until it runs dry
+ * @retval number of events merged into input, negative value if error occurred
+ * @param[in/out]   input   coalesced input, not cleared
+ */
+int CJoyStick::ReadBatch(JoyStickInput *input)
+{
+    struct js_event jse[D_JS_READ_EVENTS];
+    int cnt = 0;
+
+    while (true) {
+        ssize_t r = read(m_nJoyStickID, &jse[0], sizeof(jse));
+        if (0 > r) {
+            if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+                break;
+            }
+            return -1;
+        }
+        int n = (int) (r / sizeof(jse[0]));
+        for (int i = 0; i < n; i++) {
+            if (0 != (jse[i].type & JS_EVENT_INIT)) {
+                continue;
+            }
+            input->set(jse[i].type, jse[i].number, jse[i].value);
+            cnt++;
+        }
+        if (r < (ssize_t) sizeof(jse)) {
+            break;
+        }
+    }
+    return cnt;
+}
+
 int CJoyStick::ReadData()
 {
     struct JS_DATA_TYPE js;
@@ -28,6 +28,31 @@
 #define D_DEV_NAME_PARTS_JS "js"
 #define D_DEV_NAME          "Driving Force GT"
 
+#define D_JS_MAX_AXES       16
+#define D_JS_MAX_BUTTONS    32
+#define D_JS_READ_EVENTS    64  /* events per read() */
+
+class CInputTrace;
+
+/**
+ * @brief coalesced joystick input of one tick
+ *        axes keep only the latest value, buttons keep the latest value
+ *        and the number of presses so that no press is lost
+ */
+struct JoyStickInput
+{
+    unsigned int axisChanged;               // bit per axis
+    int axis[D_JS_MAX_AXES];                // latest value
+    unsigned int buttonChanged;             // bit per button
+    int button[D_JS_MAX_BUTTONS];           // latest value
+    unsigned char pressed[D_JS_MAX_BUTTONS];// presses (value != 0)
+    CInputTrace *trace;                     // records set(), NULL: off
+
+    void clear();
+    void set(int type, int number, int value);
+    bool pop(int *type, int *number, int *value);
+};
+
 class CJoyStick
 {
   public:
@@ -37,10 +62,13 @@ class CJoyStick
     virtual int Open();
     virtual int Close();
     virtual int Read(int *number, int *value);
+    virtual int ReadBatch(JoyStickInput *input);
     virtual int ReadData();
+    virtual void SetFeedback(double speed);
 
     int GetAxisCount() const;
     int GetButtonsCount() const;
+    int GetFd() const;
 
     enum TYPE
     {
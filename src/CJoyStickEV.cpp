@@ -10,6 +10,7 @@
  * @file    CJoyStickEV.h
  */
 #include <unistd.h>
+#include <errno.h>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -167,6 +168,49 @@ int CJoyStickEV::Read(int *num, int *val)
     return r;
 }
 
+/**
+ * @brief read all queued events
+ * @param input coalesced input(converted to js_event number/value),
+ *              not cleared
+ * @return number of events merged into input, -1:read error
+ */
+int CJoyStickEV::ReadBatch(JoyStickInput *input)
+{
+    struct input_event ie[D_JS_READ_EVENTS];
+    int cnt = 0;
+
+    while (true) {
+        ssize_t rc = read(m_nJoyStickID, &ie[0], sizeof(ie));
+        if (0 > rc) {
+            if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+                break;
+            }
+            return -1;
+        }
+        int n = (int) (rc / sizeof(ie[0]));
+        for (int i = 0; i < n; i++) {
+            int num = -1;
+            int val = -1;
+            int r = -1;
+            if (EV_KEY == ie[i].type) {
+                r = getJS_EVENT_BUTTON(num, val, ie[i]);
+            }
+            else if (EV_ABS == ie[i].type) {
+                r = getJS_EVENT_AXIS(num, val, ie[i]);
+            }
+            if (0 > r) {
+                continue;
+            }
+            input->set(r, num, val);
+            cnt++;
+        }
+        if (rc < (ssize_t) sizeof(ie)) {
+            break;
+        }
+    }
+    return cnt;
+}
+
 /**
  * test read
  */
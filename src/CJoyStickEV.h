@@ -32,6 +32,7 @@ class CJoyStickEV : public CJoyStick
     virtual int Open();
     virtual int Close();
     virtual int Read(int *number, int *value);
+    virtual int ReadBatch(JoyStickInput *input);
     virtual int ReadData();
     virtual bool getDeviceName(int fd, char* devNM, size_t sz);
     bool deviceGrab(int fd);
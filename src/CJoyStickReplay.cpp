@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Joystick input replayed from a CInputTrace
+ * @file    CJoyStickReplay.cpp
+ */
+#include "CJoyStickReplay.h"
+
+/**
+ * @brief constructor
+ * @param trace trace opened for replay, stepped by the run loop
+ */
+CJoyStickReplay::CJoyStickReplay(CInputTrace *trace)
+{
+    m_trace = trace;
+    m_ucAxes = D_JS_MAX_AXES;
+    m_ucButtons = D_JS_MAX_BUTTONS;
+}
+
+CJoyStickReplay::~CJoyStickReplay()
+{
+}
+
+/**
+ * @brief open
+ * @retval 0:trace is ready, negative value:no trace
+ *         GetFd() stays negative, there is nothing to wait for
+ */
+int CJoyStickReplay::Open()
+{
+    if ((NULL == m_trace) || (!m_trace->IsReplaying())) {
+        return -1;
+    }
+    printf("Open joystick... replay\n");
+    return 0;
+}
+
+/**
+ * @brief close
+ * @retval 0:close success
+ */
+int CJoyStickReplay::Close()
+{
+    return 0;
+}
+
+/**
+ * @brief get the next recorded return value of Read()
+ * @retval kind of input(axis or button), negative value if nothing
+ *         was recorded in this step
+ * @param[in/out]   number  number of button or axis
+ * @param[in/out]   value   value of input
+ */
+int CJoyStickReplay::Read(int *number, int *value)
+{
+    int type;
+    if (!m_trace->NextJs(&type, number, value)) {
+        return -1;
+    }
+    return type;
+}
+
+/**
+ * @brief merge all events recorded in this step
+ * @retval number of events merged into input
+ * @param[in/out]   input   coalesced input, not cleared
+ */
+int CJoyStickReplay::ReadBatch(JoyStickInput *input)
+{
+    int type;
+    int number;
+    int value;
+    int cnt = 0;
+    while (m_trace->NextJs(&type, &number, &value)) {
+        input->set(type, number, value);
+        cnt++;
+    }
+    return cnt;
+}
+
+int CJoyStickReplay::ReadData()
+{
+    return 0;
+}
+
+/**
+ * End of File.(CJoyStickReplay.cpp)
+ */
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Joystick input replayed from a CInputTrace
+ *          no device is opened, Read and ReadBatch return the events
+ *          recorded in the current step of the trace.
+ * @file    CJoyStickReplay.h
+ */
+
+#ifndef CJOYSTICKREPLAY_H_
+#define CJOYSTICKREPLAY_H_
+
+#include "CJoyStick.h"
+#include "CInputTrace.h"
+
+class CJoyStickReplay : public CJoyStick
+{
+  public:
+            CJoyStickReplay(CInputTrace *trace);
+    virtual ~CJoyStickReplay();
+
+    virtual int Open();
+    virtual int Close();
+    virtual int Read(int *number, int *value);
+    virtual int ReadBatch(JoyStickInput *input);
+    virtual int ReadData();
+
+  private:
+    CInputTrace *m_trace;
+};
+
+#endif /* CJOYSTICKREPLAY_H_ */
+/**
+ * End of File.(CJoyStickReplay.h)
+ */
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Joystick without /dev/input hardware
+ * @file    CJoyStickVirtual.cpp
+ */
+#include <errno.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <iostream>
+#include "CJoyStickVirtual.h"
+
+/**
+ * @brief constructor
+ * @param source SCRIPT / SOCKET
+ * @param path   script file or socket path
+ * @param conf   axis and button numbers, read at Open()
+ * @param clock  time of the script
+ */
+CJoyStickVirtual::CJoyStickVirtual(SOURCE source, const char *path,
+                                   const CConf *conf,
+                                   const CSimClock *clock)
+{
+    m_source = source;
+    m_path = path;
+    m_conf = conf;
+    m_clock = clock;
+    m_ucAxes = D_JS_MAX_AXES;
+    m_ucButtons = D_JS_MAX_BUTTONS;
+    m_bCycle = false;
+    m_bStarted = false;
+    m_dSpeed = 0.0;
+    m_nShift = 0;
+    m_nAccelValue = 0;
+    m_nSteerValue = 0;
+    m_pending.clear();
+    m_pending.trace = NULL;
+}
+
+CJoyStickVirtual::~CJoyStickVirtual()
+{
+    Close();
+}
+
+/**
+ * @brief open the input source
+ * @retval 0 or socket descriptor, negative value if error occurred
+ */
+int CJoyStickVirtual::Open()
+{
+    if (SCRIPT == m_source) {
+        if (!loadScript()) {
+            return -1;
+        }
+        printf("Open joystick... script %s(%s)\n", m_path.c_str(),
+               m_bCycle ? "drive cycle" : "pedals");
+        return 0;
+    }
+
+    struct sockaddr_un addr;
+    if (m_path.size() >= sizeof(addr.sun_path)) {
+        printf("joystick socket path too long: %s\n", m_path.c_str());
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (0 > fd) {
+        std::cerr << "Failed to create joystick socket(" << errno << ")."
+                  << std::endl;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, m_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(addr.sun_path);
+    if (0 > bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        std::cerr << "Failed to bind joystick socket " << m_path << "("
+                  << errno << ")." << std::endl;
+        close(fd);
+        return -1;
+    }
+    m_nJoyStickID = fd;
+    fds.fd = fd;
+    printf("Open joystick... socket %s\n", m_path.c_str());
+    return m_nJoyStickID;
+}
+
+/**
+ * @brief close the input source
+ * @retval 0:close success
+ */
+int CJoyStickVirtual::Close()
+{
+    if (0 > m_nJoyStickID) {
+        return 0;
+    }
+    CJoyStick::Close();
+    unlink(m_path.c_str());
+    return 0;
+}
+
+/**
+ * @brief get one input value
+ * @retval kind of input(axis or button), negative value if nothing
+ * @param[in/out]   number  number of button or axis
+ * @param[in/out]   value   value of input
+ */
+int CJoyStickVirtual::Read(int *number, int *value)
+{
+    int type;
+    if (!m_pending.pop(&type, number, value)) {
+        m_pending.clear();
+        ReadBatch(&m_pending);
+        if (!m_pending.pop(&type, number, value)) {
+            return -1;
+        }
+    }
+    return type;
+}
+
+/**
+ * @brief read all pending input
+ * @retval number of events merged into input, negative value if error
+ *         occurred
+ * @param[in/out]   input   coalesced input, not cleared
+ */
+int CJoyStickVirtual::ReadBatch(JoyStickInput *input)
+{
+    if (SCRIPT == m_source) {
+        return readScript(input);
+    }
+    return readSocket(input);
+}
+
+int CJoyStickVirtual::ReadData()
+{
+    return 0;
+}
+
+/**
+ * @brief vehicle speed for the drive cycle controller
+ * @param speed [km/h]
+ */
+void CJoyStickVirtual::SetFeedback(double speed)
+{
+    m_dSpeed = speed;
+}
+
+/**
+ * @brief load the drive script, the format is taken from the first point
+ * @return true:success false:failure
+ */
+bool CJoyStickVirtual::loadScript()
+{
+    FILE *fp = fopen(m_path.c_str(), "r");
+    if (NULL == fp) {
+        printf("joystick script open error: %s\n", m_path.c_str());
+        return false;
+    }
+    std::vector<VirtualJoyStickPoint> script;
+    char line[256];
+    while (NULL != fgets(line, sizeof(line), fp)) {
+        char *c = strchr(line, '#');
+        if (NULL != c) {
+            *c = '\0';
+        }
+        VirtualJoyStickPoint p;
+        memset(&p, 0, sizeof(p));
+        int n = sscanf(line, "%lf %lf %lf %lf", &p.time, &p.throttle,
+                       &p.brake, &p.steer);
+        if ((2 != n) && (4 != n)) {
+            continue;
+        }
+        if (script.empty()) {
+            m_bCycle = (2 == n);
+        }
+        if (m_bCycle != (2 == n)) {
+            printf("joystick script: mixed formats(%f)\n", p.time);
+            fclose(fp);
+            return false;
+        }
+        if (m_bCycle) {
+            p.speed = p.throttle;
+            p.throttle = 0.0;
+        }
+        if ((!script.empty()) && (p.time <= script.back().time)) {
+            printf("joystick script: time must increase(%f)\n", p.time);
+            fclose(fp);
+            return false;
+        }
+        script.push_back(p);
+    }
+    fclose(fp);
+    if (script.size() < 2) {
+        printf("joystick script: at least 2 points needed\n");
+        return false;
+    }
+    m_script = script;
+    return true;
+}
+
+/**
+ * @brief time of the script
+ * @return [sec] since the first read
+ */
+double CJoyStickVirtual::elapsed()
+{
+    struct timespec ts;
+    m_clock->GetTime(&ts);
+    if (!m_bStarted) {
+        m_tsStart = ts;
+        m_bStarted = true;
+    }
+    return (double) (ts.tv_sec - m_tsStart.tv_sec) +
+        (double) (ts.tv_nsec - m_tsStart.tv_nsec) / 1000000000.0;
+}
+
+/**
+ * @brief script input of the current time
+ *        SHIFT DOWN is pressed into DRIVE first, then the axes are sent
+ *        when their value changed
+ * @retval number of events merged into input
+ */
+int CJoyStickVirtual::readScript(JoyStickInput *input)
+{
+    int cnt = 0;
+    while (D_VJS_SHIFT_TO_DRIVE > m_nShift) {
+        input->set(JS_EVENT_BUTTON, m_conf->m_nShiftD, 1);
+        input->set(JS_EVENT_BUTTON, m_conf->m_nShiftD, 0);
+        m_nShift++;
+        cnt += 2;
+    }
+
+    const double period = m_script.back().time - m_script[0].time;
+    double t = m_script[0].time + fmod(elapsed(), period);
+    size_t k = 1;
+    while ((k + 1 < m_script.size()) && (m_script[k].time < t)) {
+        k++;
+    }
+    const VirtualJoyStickPoint &p0 = m_script[k - 1];
+    const VirtualJoyStickPoint &p1 = m_script[k];
+    double r = (t - p0.time) / (p1.time - p0.time);
+
+    double throttle;
+    double brake;
+    double steer;
+    if (m_bCycle) {
+        double target = p0.speed + (p1.speed - p0.speed) * r;
+        double pedal = (target - m_dSpeed) * D_VJS_SPEED_GAIN;
+        throttle = (0.0 < pedal) ? pedal : 0.0;
+        brake = (0.0 > pedal) ? -pedal : 0.0;
+        if ((0.0 >= target) && (0.0 == throttle)) {
+            brake = 1.0;        // hold the stop
+        }
+        steer = 0.0;
+    }
+    else {
+        throttle = p0.throttle + (p1.throttle - p0.throttle) * r;
+        brake = p0.brake + (p1.brake - p0.brake) * r;
+        steer = p0.steer + (p1.steer - p0.steer) * r;
+    }
+    throttle = (1.0 < throttle) ? 1.0 : throttle;
+    brake = (1.0 < brake) ? 1.0 : brake;
+    steer = (1.0 < steer) ? 1.0 : ((-1.0 > steer) ? -1.0 : steer);
+
+    /**
+     * one axis for both pedals: negative is throttle, positive is brake
+     */
+    int accel = (0.0 < brake) ? (int) (brake * 32767) :
+        -(int) (throttle * 32767);
+    if (accel != m_nAccelValue) {
+        input->set(JS_EVENT_AXIS, m_conf->m_nAccel, accel);
+        m_nAccelValue = accel;
+        cnt++;
+    }
+    int wheel = (int) (steer * 32767);
+    if (wheel != m_nSteerValue) {
+        input->set(JS_EVENT_AXIS, m_conf->m_nSteering, wheel);
+        m_nSteerValue = wheel;
+        cnt++;
+    }
+    return cnt;
+}
+
+/**
+ * @brief events queued on the socket
+ * @retval number of events merged into input, -1:receive error
+ */
+int CJoyStickVirtual::readSocket(JoyStickInput *input)
+{
+    struct js_event jse[D_JS_READ_EVENTS];
+    int cnt = 0;
+
+    while (true) {
+        ssize_t r = recv(m_nJoyStickID, &jse[0], sizeof(jse), 0);
+        if (0 > r) {
+            if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+                break;
+            }
+            return -1;
+        }
+        int n = (int) (r / sizeof(jse[0]));
+        for (int i = 0; i < n; i++) {
+            if (0 != (jse[i].type & JS_EVENT_INIT)) {
+                continue;
+            }
+            input->set(jse[i].type, jse[i].number, jse[i].value);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/**
+ * End of File.(CJoyStickVirtual.cpp)
+ */
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Joystick without /dev/input hardware
+ *          events come from a drive script or from a UNIX socket and use
+ *          the axis/button numbers of CarSim_Daemon.conf, so the run loop
+ *          sees the same input as from a Driving Force GT.
+ *
+ *   script (text file, one point per line, '#' starts a comment)
+ *     time[sec] speed[km/h]                    drive cycle (NEDC, WLTP...)
+ *     time[sec] throttle brake steer           pedals
+ *   throttle/brake 0.0 - 1.0, steer -1.0(left) - 1.0(right).
+ *   a drive cycle is followed by a P controller on the speed fed back
+ *   through SetFeedback(). points are interpolated linearly, the script
+ *   repeats at its end. the script is read on every tick (GetFd() < 0),
+ *   its time is the simulation clock, so it runs at any tick rate.
+ *
+ *   socket (SOCK_DGRAM, bound to the given path)
+ *     every datagram holds one or more struct js_event, the same
+ *     records as /dev/input/js*. JS_EVENT_INIT events are ignored.
+ *
+ * @file    CJoyStickVirtual.h
+ */
+
+#ifndef CJOYSTICKVIRTUAL_H_
+#define CJOYSTICKVIRTUAL_H_
+
+#include <string>
+#include <vector>
+#include "CJoyStick.h"
+#include "CConf.h"
+#include "CSimClock.h"
+
+#define D_VJS_SHIFT_TO_DRIVE    3       // SHIFT DOWN presses P -> D
+#define D_VJS_SPEED_GAIN        0.1     // pedal per km/h of speed error
+
+/**
+ * one point of the drive script
+ */
+struct VirtualJoyStickPoint
+{
+    double time;
+    double speed;           // drive cycle [km/h]
+    double throttle;        // pedals
+    double brake;
+    double steer;
+};
+
+class CJoyStickVirtual : public CJoyStick
+{
+  public:
+    enum SOURCE
+    {
+        SCRIPT = 0,
+        SOCKET
+    };
+
+            CJoyStickVirtual(SOURCE source, const char *path,
+                             const CConf *conf, const CSimClock *clock);
+    virtual ~CJoyStickVirtual();
+
+    virtual int Open();
+    virtual int Close();
+    virtual int Read(int *number, int *value);
+    virtual int ReadBatch(JoyStickInput *input);
+    virtual int ReadData();
+    virtual void SetFeedback(double speed);
+
+  private:
+    bool    loadScript();
+    int     readScript(JoyStickInput *input);
+    int     readSocket(JoyStickInput *input);
+    double  elapsed();
+
+    SOURCE  m_source;
+    std::string m_path;
+    const CConf *m_conf;
+    const CSimClock *m_clock;
+
+    /* script */
+    std::vector<VirtualJoyStickPoint> m_script;
+    bool    m_bCycle;               // true:drive cycle false:pedals
+    bool    m_bStarted;
+    struct timespec m_tsStart;      // clock of the first read
+    double  m_dSpeed;               // fed back vehicle speed [km/h]
+    int     m_nShift;               // SHIFT DOWN presses sent
+    int     m_nAccelValue;          // last axis values sent
+    int     m_nSteerValue;
+
+    /* Read() takes events one by one from here */
+    JoyStickInput m_pending;
+};
+
+#endif /* CJOYSTICKVIRTUAL_H_ */
+/**
+ * End of File.(CJoyStickVirtual.h)
+ */
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Publish policy of vehicle information
+ * @file    CPublishPolicy.cpp
+ */
+#include <math.h>
+#include <string.h>
+#include "CPublishPolicy.h"
+
+/**
+ * @brief CPublishPolicy
+ *        Constructor
+ */
+CPublishPolicy::CPublishPolicy()
+{
+    m_suppressed = 0;
+    m_heartbeats = 0;
+}
+
+/**
+ * @brief ~CPublishPolicy
+ *        destructor
+ */
+CPublishPolicy::~CPublishPolicy()
+{
+}
+
+/**
+ * @brief SetRule
+ *        rule of a property read from the AMB config, applied by Bind()
+ * @param name KeyEventType
+ * @param rule deadband and intervals
+ */
+void CPublishPolicy::SetRule(const char *name, const PublishRule &rule)
+{
+    m_rules[name] = rule;
+}
+
+/**
+ * @brief Resize
+ *        set number of handles, all rules are cleared
+ * @param n number of vehicle information
+ */
+void CPublishPolicy::Resize(int n)
+{
+    Entry e;
+    memset(&e, 0, sizeof(e));
+    m_entry.assign(n, e);
+}
+
+/**
+ * @brief Bind
+ *        apply the rule of name to a handle
+ * @param id handle of vehicle information
+ * @param name KeyEventType
+ */
+void CPublishPolicy::Bind(int id, const char *name)
+{
+    if ((id < 0) || (id >= (int) m_entry.size()) || (NULL == name)) {
+        return;
+    }
+    std::map<std::string, PublishRule>::const_iterator it =
+        m_rules.find(name);
+    if (it != m_rules.end()) {
+        m_entry[id].rule = it->second;
+        m_entry[id].configured = true;
+    }
+}
+
+/**
+ * @brief SetDefaultMinInterval
+ *        minimum interval of a property without a rule in the AMB config
+ * @param id handle of vehicle information
+ * @param msec minimum interval [ms]
+ */
+void CPublishPolicy::SetDefaultMinInterval(int id, int msec)
+{
+    if ((id < 0) || (id >= (int) m_entry.size()) ||
+        m_entry[id].configured) {
+        return;
+    }
+    m_entry[id].rule.minInterval = msec;
+}
+
+/**
+ * @brief Reset
+ *        forget the sent values, every property is sent on its next
+ *        Update()
+ */
+void CPublishPolicy::Reset()
+{
+    for (size_t i = 0; i < m_entry.size(); i++) {
+        m_entry[i].sent = false;
+    }
+}
+
+/**
+ * @brief Update
+ *        decide whether the current value is sent, a true result is
+ *        taken as sent
+ * @param id handle of vehicle information
+ * @param v current value
+ * @param n number of values, only the first D_POLICY_MAXVAL are compared
+ * @param now time of the run loop step
+ * @return true:send false:hold
+ */
+bool CPublishPolicy::Update(int id, const double *v, int n,
+                            const struct timespec *now)
+{
+    if ((id < 0) || (id >= (int) m_entry.size())) {
+        return true;
+    }
+    Entry &e = m_entry[id];
+    if (D_POLICY_MAXVAL < n) {
+        n = D_POLICY_MAXVAL;
+    }
+    if (!e.sent) {
+        Sent(id, v, n, now);
+        return true;
+    }
+
+    bool changed = (n != e.nval);
+    for (int i = 0; (!changed) && (i < n); i++) {
+        double d = fabs(v[i] - e.last[i]);
+        changed = (0.0 < e.rule.deadband) ? (d >= e.rule.deadband) :
+            (v[i] != e.last[i]);
+    }
+    long elapsed = (long) (now->tv_sec - e.tsLast.tv_sec) * 1000 +
+        (now->tv_nsec - e.tsLast.tv_nsec) / 1000000;
+    if (changed) {
+        if ((0 < e.rule.minInterval) && (elapsed < e.rule.minInterval)) {
+            m_suppressed++;
+            return false;
+        }
+    }
+    else if ((0 >= e.rule.maxInterval) || (elapsed < e.rule.maxInterval)) {
+        return false;
+    }
+    else {
+        m_heartbeats++;
+    }
+    Sent(id, v, n, now);
+    return true;
+}
+
+/**
+ * @brief Sent
+ *        record a value sent outside of Update(), e.g. on an input event
+ * @param id handle of vehicle information
+ * @param v sent value
+ * @param n number of values
+ * @param now time of the run loop step
+ */
+void CPublishPolicy::Sent(int id, const double *v, int n,
+                          const struct timespec *now)
+{
+    if ((id < 0) || (id >= (int) m_entry.size())) {
+        return;
+    }
+    Entry &e = m_entry[id];
+    if (D_POLICY_MAXVAL < n) {
+        n = D_POLICY_MAXVAL;
+    }
+    for (int i = 0; i < n; i++) {
+        e.last[i] = v[i];
+    }
+    e.nval = n;
+    e.tsLast = *now;
+    e.sent = true;
+}
+
+/**
+ * End of File.(CPublishPolicy.cpp)
+ */
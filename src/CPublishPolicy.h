@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Publish policy of vehicle information
+ *          decides per property whether the current value is sent:
+ *          a change beyond the deadband is sent unless the last send is
+ *          more recent than the minimum interval, an unchanged value is
+ *          sent again after the maximum interval (heartbeat).
+ *          rules come from VehicleInfoDefine of the AMB config, entries
+ *          are addressed by VehicleInfoNameList handle.
+ * @file    CPublishPolicy.h
+ */
+
+#ifndef CPUBLISHPOLICY_H_
+#define CPUBLISHPOLICY_H_
+
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define D_POLICY_MAXVAL 3       // values compared per property
+
+/**
+ * rule of one property, all 0: send every change
+ */
+struct PublishRule
+{
+    double deadband;            // change to send, 0: any change
+    int minInterval;            // [ms] between sends, 0: no limit
+    int maxInterval;            // [ms] heartbeat, 0: off
+};
+
+class CPublishPolicy
+{
+  public:
+            CPublishPolicy();
+    virtual ~CPublishPolicy();
+
+    void    SetRule(const char *name, const PublishRule &rule);
+    void    Resize(int n);
+    void    Bind(int id, const char *name);
+    void    SetDefaultMinInterval(int id, int msec);
+    void    Reset();
+
+    bool    Update(int id, const double *v, int n,
+                   const struct timespec *now);
+    bool    Update(int id, double v, const struct timespec *now);
+    void    Sent(int id, const double *v, int n,
+                 const struct timespec *now);
+    void    Sent(int id, double v, const struct timespec *now);
+
+    unsigned long GetSuppressCount() const;
+    unsigned long GetHeartbeatCount() const;
+
+  private:
+    struct Entry
+    {
+        PublishRule rule;
+        bool configured;        // rule from the AMB config
+        bool sent;              // value sent since Reset()
+        int nval;
+        double last[D_POLICY_MAXVAL];
+        struct timespec tsLast; // time of the last send
+    };
+
+    std::map<std::string, PublishRule> m_rules;    // by name, until Bind()
+    std::vector<Entry> m_entry;
+    unsigned long m_suppressed; // changes held back by the min interval
+    unsigned long m_heartbeats; // unchanged values sent by max interval
+};
+
+/**
+ * @brief Update
+ *        single value version
+ */
+inline bool CPublishPolicy::Update(int id, double v,
+                                   const struct timespec *now)
+{
+    return Update(id, &v, 1, now);
+}
+
+/**
+ * @brief Sent
+ *        single value version
+ */
+inline void CPublishPolicy::Sent(int id, double v, const struct timespec *now)
+{
+    Sent(id, &v, 1, now);
+}
+
+/**
+ * @brief GetSuppressCount
+ * @return changes held back by the minimum interval
+ */
+inline unsigned long CPublishPolicy::GetSuppressCount() const
+{
+    return m_suppressed;
+}
+
+/**
+ * @brief GetHeartbeatCount
+ * @return unchanged values sent again by the maximum interval
+ */
+inline unsigned long CPublishPolicy::GetHeartbeatCount() const
+{
+    return m_heartbeats;
+}
+
+#endif /* CPUBLISHPOLICY_H_ */
+/**
+ * End of File.(CPublishPolicy.h)
+ */
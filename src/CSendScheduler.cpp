@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Priority scheduler of outbound vehicle information
+ * @file    CSendScheduler.cpp
+ */
+#include <string.h>
+#include "CSendScheduler.h"
+
+/**
+ * @brief CSendScheduler
+ *        Constructor, nothing is deferred
+ */
+CSendScheduler::CSendScheduler()
+{
+    m_deferLevel = D_SCHED_LEVELS;
+    for (int i = 0; i < D_SCHED_LEVELS; i++) {
+        m_maxDepth[i] = 0;
+        m_sent[i] = 0;
+        m_deferred[i] = 0;
+        m_coalesced[i] = 0;
+    }
+}
+
+/**
+ * @brief ~CSendScheduler
+ *        destructor
+ */
+CSendScheduler::~CSendScheduler()
+{
+}
+
+/**
+ * @brief SetDeferLevel
+ * @param level first level held back while a connection is congested,
+ *              D_SCHED_LEVELS: never hold back
+ */
+void CSendScheduler::SetDeferLevel(int level)
+{
+    m_deferLevel = level;
+}
+
+/**
+ * @brief Stage
+ *        add a record to the current step. a deferrable level keeps one
+ *        record per key, a newer value replaces the staged one
+ * @param conn connection
+ * @param level priority level
+ * @param id handle of vehicle information
+ * @param data status bytes
+ * @param size size of data
+ * @return true:staged false:not stageable, the caller sends it directly
+ */
+bool CSendScheduler::Stage(int conn, int level, int id, const void *data,
+                           int size)
+{
+    if ((conn < 0) || (conn >= D_SCHED_CONNECTIONS) || (size < 0) ||
+        (size > D_SCHED_MAXDATA)) {
+        return false;
+    }
+    if (level < 0) {
+        level = 0;
+    }
+    if (level >= D_SCHED_LEVELS) {
+        level = D_SCHED_LEVELS - 1;
+    }
+    std::vector<SchedRecord> &q = m_queue[conn][level];
+    if (level >= m_deferLevel) {
+        for (size_t i = 0; i < q.size(); i++) {
+            if (q[i].id == id) {
+                q[i].size = size;
+                memcpy(q[i].data, data, size);
+                m_coalesced[level]++;
+                return true;
+            }
+        }
+    }
+    /* capacity is kept by clear(), no allocation after the first steps */
+    q.resize(q.size() + 1);
+    SchedRecord &r = q.back();
+    r.id = id;
+    r.size = size;
+    memcpy(r.data, data, size);
+    int depth = GetDepth(level);
+    if (depth > m_maxDepth[level]) {
+        m_maxDepth[level] = depth;
+    }
+    return true;
+}
+
+/**
+ * @brief Flush
+ *        write the staged records of a connection, most urgent level
+ *        first
+ * @param conn connection
+ * @param congested hold back the deferrable levels
+ * @param writer writes one record
+ * @param arg argument of writer
+ */
+void CSendScheduler::Flush(int conn, bool congested, Writer writer,
+                           void *arg)
+{
+    if ((conn < 0) || (conn >= D_SCHED_CONNECTIONS)) {
+        return;
+    }
+    for (int level = 0; level < D_SCHED_LEVELS; level++) {
+        std::vector<SchedRecord> &q = m_queue[conn][level];
+        if (q.empty()) {
+            continue;
+        }
+        if (congested && (level >= m_deferLevel)) {
+            m_deferred[level]++;
+            continue;
+        }
+        for (size_t i = 0; i < q.size(); i++) {
+            if (writer(conn, &q[i], arg)) {
+                m_sent[level]++;
+            }
+        }
+        q.clear();
+    }
+}
+
+/**
+ * @brief Clear
+ *        drop all staged records
+ */
+void CSendScheduler::Clear()
+{
+    for (int conn = 0; conn < D_SCHED_CONNECTIONS; conn++) {
+        for (int level = 0; level < D_SCHED_LEVELS; level++) {
+            m_queue[conn][level].clear();
+        }
+    }
+}
+
+/**
+ * @brief GetDepth
+ * @param level priority level
+ * @return records staged on a level now, all connections
+ */
+int CSendScheduler::GetDepth(int level) const
+{
+    int depth = 0;
+    for (int conn = 0; conn < D_SCHED_CONNECTIONS; conn++) {
+        depth += (int) m_queue[conn][level].size();
+    }
+    return depth;
+}
+
+/**
+ * End of File.(CSendScheduler.cpp)
+ */
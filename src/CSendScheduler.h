@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Priority scheduler of outbound vehicle information
+ *          records of a run loop step are staged per connection and
+ *          priority level, and written in level order when the step is
+ *          flushed. while a connection is congested the deferrable
+ *          levels are held back and coalesced per key (latest wins).
+ *          level 0 is the most urgent.
+ * @file    CSendScheduler.h
+ */
+
+#ifndef CSENDSCHEDULER_H_
+#define CSENDSCHEDULER_H_
+
+#include <vector>
+
+#define D_SCHED_CONNECTIONS     4
+#define D_SCHED_LEVELS          4
+#define D_SCHED_MAXDATA         128     // status bytes of one record
+
+/**
+ * one staged record
+ */
+struct SchedRecord
+{
+    int id;                     // VehicleInfoNameList handle
+    int size;                   // status bytes
+    char data[D_SCHED_MAXDATA];
+};
+
+class CSendScheduler
+{
+  public:
+    /**
+     * @brief record writer
+     * @param conn connection
+     * @param rec record to write
+     * @param arg user argument given to Flush()
+     * @return true:written false:failure(the record is dropped)
+     */
+    typedef bool (*Writer)(int conn, const SchedRecord *rec, void *arg);
+
+            CSendScheduler();
+    virtual ~CSendScheduler();
+
+    void    SetDeferLevel(int level);
+    bool    Stage(int conn, int level, int id, const void *data, int size);
+    void    Flush(int conn, bool congested, Writer writer, void *arg);
+    void    Clear();
+
+    int     GetDepth(int level) const;
+    int     GetMaxDepth(int level) const;
+    unsigned long GetSentCount(int level) const;
+    unsigned long GetDeferCount(int level) const;
+    unsigned long GetCoalesceCount(int level) const;
+
+  private:
+    std::vector<SchedRecord> m_queue[D_SCHED_CONNECTIONS][D_SCHED_LEVELS];
+    int     m_deferLevel;       // first level held back when congested
+    int     m_maxDepth[D_SCHED_LEVELS];
+    unsigned long m_sent[D_SCHED_LEVELS];
+    unsigned long m_deferred[D_SCHED_LEVELS];   // flushes held back
+    unsigned long m_coalesced[D_SCHED_LEVELS];  // records replaced
+};
+
+/**
+ * @brief GetMaxDepth
+ * @param level priority level
+ * @return largest number of records staged on a level, all connections
+ */
+inline int CSendScheduler::GetMaxDepth(int level) const
+{
+    return m_maxDepth[level];
+}
+
+/**
+ * @brief GetSentCount
+ * @param level priority level
+ * @return records of a level the writer accepted
+ */
+inline unsigned long CSendScheduler::GetSentCount(int level) const
+{
+    return m_sent[level];
+}
+
+/**
+ * @brief GetDeferCount
+ * @param level priority level
+ * @return flushes of a connection which held the level back
+ */
+inline unsigned long CSendScheduler::GetDeferCount(int level) const
+{
+    return m_deferred[level];
+}
+
+/**
+ * @brief GetCoalesceCount
+ * @param level priority level
+ * @return held back records replaced by a newer value of the same key
+ */
+inline unsigned long CSendScheduler::GetCoalesceCount(int level) const
+{
+    return m_coalesced[level];
+}
+
+#endif /* CSENDSCHEDULER_H_ */
+/**
+ * End of File.(CSendScheduler.h)
+ */
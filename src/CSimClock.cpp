@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Simulation clock
+ * @file    CSimClock.cpp
+ */
+#include "CSimClock.h"
+
+/**
+ * @brief CSimClock
+ *        Constructor, real time
+ */
+CSimClock::CSimClock()
+{
+    SetVirtual(false);
+}
+
+/**
+ * @brief ~CSimClock
+ *        destructor
+ */
+CSimClock::~CSimClock()
+{
+}
+
+/**
+ * @brief SetVirtual
+ *        select real or virtual time, both restart GetElapsed().
+ *        virtual time starts at the current time and stands still
+ *        until Advance().
+ * @param bVirtual true:virtual time false:real time
+ */
+void CSimClock::SetVirtual(bool bVirtual)
+{
+    m_bVirtual = bVirtual;
+    clock_gettime(CLOCK_MONOTONIC, &m_tsStart);
+    gettimeofday(&m_tvNow, NULL);
+    m_tsNow = m_tsStart;
+}
+
+/**
+ * @brief Advance
+ *        move virtual time forward, ignored in real mode
+ * @param nsec nano sec
+ */
+void CSimClock::Advance(long nsec)
+{
+    if (!m_bVirtual) {
+        return;
+    }
+    m_tsNow.tv_sec += nsec / 1000000000L;
+    m_tsNow.tv_nsec += nsec % 1000000000L;
+    if (m_tsNow.tv_nsec >= 1000000000L) {
+        m_tsNow.tv_nsec -= 1000000000L;
+        m_tsNow.tv_sec++;
+    }
+    m_tvNow.tv_sec += nsec / 1000000000L;
+    m_tvNow.tv_usec += (nsec % 1000000000L) / 1000;
+    if (m_tvNow.tv_usec >= 1000000L) {
+        m_tvNow.tv_usec -= 1000000L;
+        m_tvNow.tv_sec++;
+    }
+}
+
+/**
+ * @brief Set
+ *        jump to the given time (recorded or sampled elsewhere),
+ *        ignored in real mode
+ * @param ts monotonic time
+ * @param tv wall clock time
+ */
+void CSimClock::Set(const struct timespec *ts, const struct timeval *tv)
+{
+    if (!m_bVirtual) {
+        return;
+    }
+    m_tsNow = *ts;
+    m_tvNow = *tv;
+}
+
+/**
+ * @brief GetTime
+ *        replacement of clock_gettime(CLOCK_MONOTONIC)
+ * @param ts current time
+ */
+void CSimClock::GetTime(struct timespec *ts) const
+{
+    if (m_bVirtual) {
+        *ts = m_tsNow;
+    }
+    else {
+        clock_gettime(CLOCK_MONOTONIC, ts);
+    }
+}
+
+/**
+ * @brief GetTimeOfDay
+ *        replacement of gettimeofday(), virtual time starts at the wall
+ *        clock time of SetVirtual()
+ * @param tv current time
+ */
+void CSimClock::GetTimeOfDay(struct timeval *tv) const
+{
+    if (m_bVirtual) {
+        *tv = m_tvNow;
+    }
+    else {
+        gettimeofday(tv, NULL);
+    }
+}
+
+/**
+ * @brief GetElapsed
+ * @return time since SetVirtual() [sec]
+ */
+double CSimClock::GetElapsed() const
+{
+    struct timespec ts;
+    GetTime(&ts);
+    return (double) (ts.tv_sec - m_tsStart.tv_sec) +
+        (double) (ts.tv_nsec - m_tsStart.tv_nsec) / 1000000000.0;
+}
+
+/**
+ * End of File.(CSimClock.cpp)
+ */
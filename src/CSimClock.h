@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Simulation clock
+ *          real mode reads CLOCK_MONOTONIC / gettimeofday.
+ *          virtual mode only moves by Advance() or Set(), so a drive can be
+ *          simulated faster than real time and gives the same result on
+ *          every run.
+ * @file    CSimClock.h
+ */
+
+#ifndef CSIMCLOCK_H_
+#define CSIMCLOCK_H_
+
+#include <time.h>
+#include <sys/time.h>
+
+class CSimClock
+{
+  public:
+            CSimClock();
+    virtual ~CSimClock();
+
+    void    SetVirtual(bool bVirtual);
+    bool    IsVirtual() const;
+    void    Advance(long nsec);
+    void    Set(const struct timespec *ts, const struct timeval *tv);
+
+    void    GetTime(struct timespec *ts) const;
+    void    GetTimeOfDay(struct timeval *tv) const;
+    double  GetElapsed() const;
+
+  private:
+    bool    m_bVirtual;
+    struct timespec m_tsStart;  // monotonic time of SetVirtual()
+    struct timespec m_tsNow;    // virtual monotonic time
+    struct timeval m_tvNow;     // virtual wall clock time
+};
+
+/**
+ * @brief IsVirtual
+ * @return true:virtual time false:real time
+ */
+inline bool CSimClock::IsVirtual() const
+{
+    return m_bVirtual;
+}
+
+#endif /* CSIMCLOCK_H_ */
+/**
+ * End of File.(CSimClock.h)
+ */
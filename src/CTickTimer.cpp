@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Fixed-rate tick scheduler
+ * @file    CTickTimer.cpp
+ */
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <iostream>
+#include "CTickTimer.h"
+
+/**
+ * @brief CTickTimer
+ *        Constructor
+ */
+CTickTimer::CTickTimer()
+{
+    m_fd = -1;
+    m_hz = 0;
+    m_ticks = 0;
+    m_overruns = 0;
+}
+
+/**
+ * @brief ~CTickTimer
+ *        destructor
+ */
+CTickTimer::~CTickTimer()
+{
+    Stop();
+}
+
+/**
+ * @brief Start
+ *        arm a periodic timer whose first deadline is one period from now
+ * @param hz tick rate
+ * @return true:success false:failure
+ */
+bool CTickTimer::Start(int hz)
+{
+    if (0 >= hz) {
+        return false;
+    }
+    Stop();
+
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (0 > m_fd) {
+        std::cerr << "Failed to create tick timer(" << errno << ")."
+                  << std::endl;
+        return false;
+    }
+
+    long period = 1000000000L / hz;     // nano sec
+    struct itimerspec its;
+    clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+    its.it_value.tv_nsec += period;
+    while (its.it_value.tv_nsec >= 1000000000L) {
+        its.it_value.tv_nsec -= 1000000000L;
+        its.it_value.tv_sec++;
+    }
+    its.it_interval.tv_sec = period / 1000000000L;
+    its.it_interval.tv_nsec = period % 1000000000L;
+
+    /**
+     * absolute first deadline + kernel side interval:
+     * every later deadline is start + n * period, independent of
+     * how long the caller took between two Wait()
+     */
+    if (0 > timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &its, NULL)) {
+        std::cerr << "Failed to set tick timer(" << errno << ")."
+                  << std::endl;
+        Stop();
+        return false;
+    }
+    m_hz = hz;
+    m_ticks = 0;
+    m_overruns = 0;
+    return true;
+}
+
+/**
+ * @brief Stop
+ *        disarm and release the timer
+ */
+void CTickTimer::Stop()
+{
+    if (0 > m_fd) {
+        return;
+    }
+    close(m_fd);
+    m_fd = -1;
+}
+
+/**
+ * @brief Wait
+ *        block until the next deadline
+ * @return number of deadlines passed since the previous call
+ *         (more than 1 means overrun), negative value if error occurred
+ */
+int CTickTimer::Wait()
+{
+    if (0 > m_fd) {
+        return -1;
+    }
+    uint64_t exp = 0;
+    ssize_t r = read(m_fd, &exp, sizeof(exp));
+    if (r != (ssize_t) sizeof(exp)) {
+        return -1;
+    }
+    m_ticks += (unsigned long) exp;
+    if (1 < exp) {
+        m_overruns += (unsigned long) (exp - 1);
+    }
+    return (int) exp;
+}
+
+/**
+ * End of File.(CTickTimer.cpp)
+ */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @brief   Fixed-rate tick scheduler
+ *          Deadlines are absolute (CLOCK_MONOTONIC), so the loop period
+ *          does not stretch by the time spent in the loop body.
+ * @file    CTickTimer.h
+ */
+
+#ifndef CTICKTIMER_H_
+#define CTICKTIMER_H_
+
+#include <time.h>
+
+class CTickTimer
+{
+  public:
+            CTickTimer();
+    virtual ~CTickTimer();
+
+    bool    Start(int hz);
+    void    Stop();
+    int     Wait();
+
+    int     GetFd() const;
+    int     GetRate() const;
+    unsigned long GetTickCount() const;
+    unsigned long GetOverrunCount() const;
+
+  private:
+    int     m_fd;               // timerfd
+    int     m_hz;               // tick rate
+    unsigned long m_ticks;      // elapsed ticks (including overruns)
+    unsigned long m_overruns;   // ticks missed because the loop ran late
+};
+
+/**
+ * @brief GetFd
+ * @return timer file descriptor, negative value if not started
+ */
+inline int CTickTimer::GetFd() const
+{
+    return m_fd;
+}
+
+/**
+ * @brief GetRate
+ * @return tick rate [Hz]
+ */
+inline int CTickTimer::GetRate() const
+{
+    return m_hz;
+}
+
+/**
+ * @brief GetTickCount
+ * @return number of elapsed ticks
+ */
+inline unsigned long CTickTimer::GetTickCount() const
+{
+    return m_ticks;
+}
+
+/**
+ * @brief GetOverrunCount
+ * @return number of ticks that expired while the loop was still busy
+ */
+inline unsigned long CTickTimer::GetOverrunCount() const
+{
+    return m_overruns;
+}
+
+#endif /* CTICKTIMER_H_ */
+/**
+ * End of File.(CTickTimer.h)
+ */
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @file    CarSim_Amb.cpp
+ * @brief   local stand-in of ambd for load and latency tests
+ *
+ *          listens on the four AMB ports (CAmbServer) so carsim runs
+ *          without ambd, and records per key message rate, inter-arrival
+ *          jitter and end-to-end latency(arrival - record time, carsim
+ *          must run on the real clock of this host).
+ *          a report is printed every -s seconds and at exit.
+ *          -R restarts the server periodically to test the reconnect of
+ *          carsim.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "CAmbServer.h"
+#include "CEventLoop.h"
+
+#define VERSION "0.1.2"
+
+#define D_AMBSV_DEFAULT_REPORT  5       // [s]
+#define D_AMBSV_RESTART_DOWN    1000    // [ms] not listening on restart
+
+static volatile bool g_bStop = false;
+
+static void signalHandler(int /*signo*/)
+{
+    g_bStop = true;
+}
+
+/**
+ * statistics of one key on one port
+ */
+struct KeyStats
+{
+    unsigned long count;
+    unsigned long window;       // count since the last periodic report
+    struct timespec first;
+    struct timespec last;
+    /* inter-arrival interval [ms], Welford */
+    unsigned long nIntv;
+    double intvMean;
+    double intvM2;
+    double intvMax;
+    /* end-to-end latency [ms] */
+    std::vector<double> latency;
+};
+
+typedef std::map<std::string, KeyStats> StatsMap;
+
+static double diffMs(const struct timespec *t1, const struct timespec *t0)
+{
+    return (double) (t1->tv_sec - t0->tv_sec) * 1000.0 +
+        (double) (t1->tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+static void onRecord(const AmbRecord *rec, void *arg)
+{
+    StatsMap *stats = reinterpret_cast < StatsMap * >(arg);
+    char key[80];
+    if (NULL != rec->name) {
+        snprintf(key, sizeof(key), "%d:%s", rec->port, rec->name);
+    }
+    else {
+        snprintf(key, sizeof(key), "%d:#%d", rec->port, rec->id);
+    }
+    KeyStats &s = (*stats)[key];
+    if (0 == s.count) {
+        s.first = rec->recv;
+    }
+    else {
+        double d = diffMs(&rec->recv, &s.last);
+        s.nIntv++;
+        double delta = d - s.intvMean;
+        s.intvMean += delta / (double) s.nIntv;
+        s.intvM2 += delta * (d - s.intvMean);
+        if (d > s.intvMax) {
+            s.intvMax = d;
+        }
+    }
+    s.last = rec->recv;
+    s.count++;
+    s.window++;
+    s.latency.push_back((double) (rec->recvtime.tv_sec - rec->time.tv_sec)
+                        * 1000.0 +
+                        (double) (rec->recvtime.tv_usec -
+                                  rec->time.tv_usec) / 1000.0);
+}
+
+static double percentile(const std::vector<double> &v, double p)
+{
+    if (v.empty()) {
+        return 0.0;
+    }
+    size_t i = (size_t) (p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+/**
+ * @brief report
+ *        per key statistics, latency samples are sorted in place
+ */
+static void report(StatsMap &stats, FILE *json)
+{
+    printf("%-28s %8s %9s %9s %9s %9s %9s %9s\n", "port:key", "count",
+           "rate/s", "intv ms", "jitter", "lat p50", "lat p99", "lat max");
+    if (NULL != json) {
+        fprintf(json, "  \"keys\": [");
+    }
+    bool first = true;
+    for (StatsMap::iterator it = stats.begin(); it != stats.end(); ++it) {
+        KeyStats &s = it->second;
+        double span = diffMs(&s.last, &s.first);
+        double rate = (0.0 < span) ? (double) (s.count - 1) * 1000.0 / span
+            : 0.0;
+        double jitter = (1 < s.nIntv) ?
+            sqrt(s.intvM2 / (double) (s.nIntv - 1)) : 0.0;
+        std::sort(s.latency.begin(), s.latency.end());
+        double p50 = percentile(s.latency, 0.50);
+        double p99 = percentile(s.latency, 0.99);
+        double max = s.latency.empty() ? 0.0 : s.latency.back();
+        printf("%-28s %8lu %9.2f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+               it->first.c_str(), s.count, rate, s.intvMean, jitter, p50, p99,
+               max);
+        if (NULL != json) {
+            fprintf(json, "%s\n    {\"key\": \"%s\", \"count\": %lu, "
+                    "\"rate\": %.3f, \"interval_ms\": %.3f, "
+                    "\"interval_max_ms\": %.3f, \"jitter_ms\": %.3f, "
+                    "\"latency_p50_ms\": %.3f, \"latency_p99_ms\": %.3f, "
+                    "\"latency_max_ms\": %.3f}", first ? "" : ",",
+                    it->first.c_str(), s.count, rate, s.intvMean, s.intvMax,
+                    jitter, p50, p99, max);
+        }
+        first = false;
+    }
+    if (NULL != json) {
+        fprintf(json, "\n  ]\n");
+    }
+}
+
+static bool parsePorts(const char *s, int port[D_AMB_PORTS])
+{
+    return (D_AMB_PORTS == sscanf(s, "%d,%d,%d,%d", &port[0], &port[1],
+                                  &port[2], &port[3]));
+}
+
+int main(int argc, char **argv)
+{
+    int port[D_AMB_PORTS] = { 0, 0, 0, 0 };
+    bool bPorts = false;
+    bool bCompact = false;
+    int interval = D_AMBSV_DEFAULT_REPORT;
+    int duration = 0;
+    int restart = 0;
+    const char *jsonPath = NULL;
+    int result = 0;
+
+    while ((result = getopt(argc, argv, "P:s:d:R:o:Ch")) != -1) {
+        switch (result) {
+        case 'P':
+            bPorts = parsePorts(optarg, port);
+            break;
+        case 's':
+            interval = atoi(optarg);
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'R':
+            restart = atoi(optarg);
+            break;
+        case 'o':
+            jsonPath = optarg;
+            break;
+        case 'C':
+            bCompact = true;
+            break;
+        case 'h':
+        default:
+            printf("Usage: carsim_amb -P port,port,port,port [-s sec] "
+                   "[-d sec] [-R sec] [-o result.json] [-C]\n");
+            printf("  -P\t DataPort,CtrlPort of DefaultInfoPort and "
+                   "CustomizeInfoPort(AMB config)\n");
+            printf("  -s\t report interval(default %ds, 0:at exit only)\n",
+                   D_AMBSV_DEFAULT_REPORT);
+            printf("  -d\t stop after(default 0:until SIGINT)\n");
+            printf("  -R\t close all connections and stop listening for "
+                   "%dms every(default 0:never)\n", D_AMBSV_RESTART_DOWN);
+            printf("  -o\t save results as JSON\n");
+            printf("  -C\t acknowledge the compact format\n");
+            return ('h' == result) ? 0 : 1;
+        }
+    }
+    if ((!bPorts) || (0 > interval) || (0 > duration) || (0 > restart)) {
+        printf("invalid arguments, see -h\n");
+        return 1;
+    }
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    StatsMap stats;
+    CEventLoop loop;
+    CAmbServer amb;
+    if ((!loop.Open()) ||
+        (!amb.Start(port, &loop, onRecord, &stats, bCompact))) {
+        return 1;
+    }
+    printf("listening on ports %d,%d,%d,%d\n", port[0], port[1], port[2],
+           port[3]);
+
+    struct timespec tStart;
+    struct timespec tReport;
+    struct timespec tRestart;
+    clock_gettime(CLOCK_MONOTONIC, &tStart);
+    tReport = tStart;
+    tRestart = tStart;
+    bool connected[D_AMB_PORTS] = { false, false, false, false };
+    while (!g_bStop) {
+        if (0 > loop.Dispatch(100)) {
+            break;
+        }
+        for (int i = 0; i < D_AMB_PORTS; i++) {
+            if (connected[i] != amb.IsConnected(i)) {
+                connected[i] = amb.IsConnected(i);
+                printf("port %d %s\n", port[i],
+                       connected[i] ? "connected" : "disconnected");
+            }
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((0 < interval) && (diffMs(&now, &tReport) >= interval * 1000.0)) {
+            unsigned long n = 0;
+            for (StatsMap::iterator it = stats.begin(); it != stats.end();
+                 ++it) {
+                n += it->second.window;
+                it->second.window = 0;
+            }
+            printf("%.1fs: %lu records, %.1f/s, frames %lu/%lu/%lu/%lu\n",
+                   diffMs(&now, &tStart) / 1000.0, n,
+                   (double) n * 1000.0 / diffMs(&now, &tReport),
+                   amb.GetFrameCount(0), amb.GetFrameCount(1),
+                   amb.GetFrameCount(2), amb.GetFrameCount(3));
+            tReport = now;
+        }
+        if ((0 < duration) && (diffMs(&now, &tStart) >= duration * 1000.0)) {
+            break;
+        }
+        if ((0 < restart) && (diffMs(&now, &tRestart) >= restart * 1000.0)) {
+            printf("restart: down for %dms\n", D_AMBSV_RESTART_DOWN);
+            amb.Stop();
+            usleep(D_AMBSV_RESTART_DOWN * 1000);
+            if (!amb.Start(port, &loop, onRecord, &stats, bCompact)) {
+                break;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &tRestart);
+        }
+    }
+    amb.Stop();
+    loop.Close();
+
+    FILE *fp = NULL;
+    if (NULL != jsonPath) {
+        fp = fopen(jsonPath, "w");
+        if (NULL == fp) {
+            perror(jsonPath);
+        }
+    }
+    if (NULL != fp) {
+        struct utsname u;
+        memset(&u, 0, sizeof(u));
+        uname(&u);
+        fprintf(fp, "{\n");
+        fprintf(fp, "  \"version\": \"%s\",\n", VERSION);
+        fprintf(fp, "  \"machine\": \"%s\",\n", u.machine);
+        fprintf(fp, "  \"kernel\": \"%s\",\n", u.release);
+        fprintf(fp, "  \"time\": %ld,\n", (long) time(NULL));
+        fprintf(fp, "  \"frames\": [%lu, %lu, %lu, %lu],\n",
+                amb.GetFrameCount(0), amb.GetFrameCount(1),
+                amb.GetFrameCount(2), amb.GetFrameCount(3));
+    }
+    report(stats, fp);
+    if (NULL != fp) {
+        fprintf(fp, "}\n");
+        fclose(fp);
+    }
+    return 0;
+}
+
+/**
+ * End of File.(CarSim_Amb.cpp)
+ */
@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @file    CarSim_Bench.cpp
+ * @brief   microbenchmark of physics / geodesy kernels
+ *
+ *          every kernel reports ns/op, heap allocations/op and CPU
+ *          cycles/op (perf_event, n/a if the kernel does not allow it).
+ *          results can be saved as JSON to compare releases on a board.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include "CCalc.h"
+#include "CAvgCar.h"
+#include "CConf.h"
+#include "CFleet.h"
+#include "Websocket.h"
+
+#define VERSION "0.1.2"
+
+#define D_BENCH_DEFAULT_ITERATIONS  1000000
+#define D_BENCH_MAX_RESULTS         32
+
+/******************************************
+ * heap allocation counter
+ * malloc family is replaced for the whole process (glibc allows it),
+ * operator new of libstdc++ ends up here as well.
+******************************************/
+static unsigned long g_nAlloc = 0;
+
+extern "C" {
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) __THROW
+{
+    g_nAlloc++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) __THROW
+{
+    g_nAlloc++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) __THROW
+{
+    g_nAlloc++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) __THROW
+{
+    __libc_free(ptr);
+}
+}
+
+/******************************************
+ * CPU cycle counter
+******************************************/
+class CCycleCounter
+{
+  public:
+            CCycleCounter();
+            ~CCycleCounter();
+    bool    isValid() const;
+    void    Start();
+    long long Stop();
+  private:
+    int     m_fd;
+};
+
+CCycleCounter::CCycleCounter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+CCycleCounter::~CCycleCounter()
+{
+    if (0 <= m_fd) {
+        close(m_fd);
+    }
+}
+
+inline bool CCycleCounter::isValid() const
+{
+    return (0 <= m_fd);
+}
+
+void CCycleCounter::Start()
+{
+    if (0 <= m_fd) {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/**
+ * @brief Stop
+ * @return cycles since Start(), negative value if not available
+ */
+long long CCycleCounter::Stop()
+{
+    if (0 > m_fd) {
+        return -1;
+    }
+    ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long cycles = 0;
+    if (read(m_fd, &cycles, sizeof(cycles)) != (ssize_t) sizeof(cycles)) {
+        return -1;
+    }
+    return cycles;
+}
+
+/******************************************
+ * kernels
+ * every kernel runs n operations and writes its result to g_sink,
+ * so the compiler cannot drop the work.
+******************************************/
+volatile double g_sink = 0.0;
+static char g_confPath[260];
+
+static void benchCalcDest(long n)
+{
+    double lat = 35.717931;
+    double lng = 139.736518;
+    double azim = 0.0;
+    for (long i = 0; i < n; i++) {
+        POINT p = CalcDest(lat, lng, azim, 1.5);
+        lat = p.lat;
+        lng = p.lng;
+        azim += 0.1;
+        if (360.0 <= azim) {
+            azim -= 360.0;
+        }
+    }
+    g_sink = lat + lng;
+}
+
+static void benchCalcDestFast(long n)
+{
+    double lat = 35.717931;
+    double lng = 139.736518;
+    double azim = 0.0;
+    GEORADII radii;
+    radii.valid = false;
+    for (long i = 0; i < n; i++) {
+        POINT p = CalcDestFast(lat, lng, azim, 1.5, &radii);
+        lat = p.lat;
+        lng = p.lng;
+        azim += 0.1;
+        if (360.0 <= azim) {
+            azim -= 360.0;
+        }
+    }
+    g_sink = lat + lng;
+}
+
+#define D_BENCH_VEHICLES    1024
+
+/**
+ * one op = one vehicle step(CalcAzimuth + CalcDestFast)
+ */
+static void benchCalcStepBatch(long n, CALC_SIMD simd)
+{
+    static double lat[D_BENCH_VEHICLES];
+    static double lng[D_BENCH_VEHICLES];
+    static double azim[D_BENCH_VEHICLES];
+    static double dist[D_BENCH_VEHICLES];
+    static double steer[D_BENCH_VEHICLES];
+    for (int i = 0; i < D_BENCH_VEHICLES; i++) {
+        lat[i] = 35.0 + (double) i / D_BENCH_VEHICLES;
+        lng[i] = 139.0 + (double) i / D_BENCH_VEHICLES;
+        azim[i] = (double) (i % 360);
+        dist[i] = 1.5;
+        steer[i] = (double) ((i % 61) - 30);
+    }
+    CalcSetSimd(simd);
+    for (long i = 0; i < n; i += D_BENCH_VEHICLES) {
+        CalcStepBatch(D_BENCH_VEHICLES, lat, lng, azim, dist, steer);
+    }
+    CalcSetSimd(CALC_SIMD_AUTO);
+    g_sink = lat[0] + lng[D_BENCH_VEHICLES - 1];
+}
+
+static void benchCalcStepScalar(long n)
+{
+    benchCalcStepBatch(n, CALC_SIMD_SCALAR);
+}
+
+static void benchCalcStepSSE2(long n)
+{
+    benchCalcStepBatch(n, CALC_SIMD_SSE2);
+}
+
+static void benchCalcStepAVX2(long n)
+{
+    benchCalcStepBatch(n, CALC_SIMD_AVX2);
+}
+
+/**
+ * one op = one vehicle step of CFleet(inputs, longitudinal model and
+ * CalcStepBatch), the fleet is opened by the warm up run
+ */
+static CFleet g_fleet1;
+static CFleet g_fleet4;
+
+static void benchFleetStep(long n, CFleet *fleet, int threads)
+{
+    if (0 == fleet->GetSize()) {
+        fleet->Open(D_BENCH_VEHICLES, threads, 35.717931, 139.736518, 1);
+    }
+    for (long i = 0; i < n; i += D_BENCH_VEHICLES) {
+        fleet->Step(0.01);
+    }
+    g_sink = fleet->GetLat()[0];
+}
+
+static void benchFleetStep1(long n)
+{
+    benchFleetStep(n, &g_fleet1, 1);
+}
+
+static void benchFleetStep4(long n)
+{
+    benchFleetStep(n, &g_fleet4, 4);
+}
+
+static void benchCalcAzimuth(long n)
+{
+    double azim = 0.0;
+    for (long i = 0; i < n; i++) {
+        azim = CalcAzimuth(azim, (double) ((i % 61) - 30), 1.5);
+    }
+    g_sink = azim;
+}
+
+static void benchAvgCar(long n)
+{
+    CAvgCar car(60, 180, 20);
+    car.chgGear(CAvgGear::E_SHIFT_DRIVE);
+    for (long i = 0; i < n; i++) {
+        if (0 == (i % 256)) {
+            car.chgThrottle((int) ((i * 7) % 65535));
+        }
+        car.updateAvg();
+    }
+    g_sink = car.getSpeed() + car.getRPM();
+}
+
+static void benchAverageSetSample(long n)
+{
+    averageMachine avg(180);
+    for (long i = 0; i < n; i++) {
+        avg.setSample((double) (i & 255));
+    }
+    g_sink = avg.getAvg();
+}
+
+static void benchAverageReCalc(long n)
+{
+    averageMachine avg(180);
+    for (int i = 0; i < 180; i++) {
+        avg.setSample((double) i);
+    }
+    for (long i = 0; i < n; i++) {
+        avg.reCalc();
+    }
+    g_sink = avg.getAvg();
+}
+
+static void benchRecvQueue(long n)
+{
+    WebsocketRecvQueue queue(16);
+    char in[sizeof(KeyDataMsg_t) + sizeof(double) * 3];
+    char out[WebsocketRecvQueue::maxdatasize];
+    memset(in, 0, sizeof(in));
+    for (long i = 0; i < n; i++) {
+        in[0] = (char) i;
+        queue.push(in, sizeof(in));
+        queue.front(out);
+        queue.pop();
+    }
+    g_sink = out[0];
+}
+
+static void benchGetConfig(long n)
+{
+    int sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += CConf::GetConfig(g_confPath, "RUNLOOP", "TICK_HZ", 100);
+    }
+    g_sink = sum;
+}
+
+typedef void (*BenchFunc)(long n);
+
+struct BenchCase
+{
+    const char *name;
+    BenchFunc func;
+    long divisor;               // heavy kernels run iterations / divisor
+};
+
+static const BenchCase g_cases[] = {
+    { "CalcDest",                   benchCalcDest,          10 },
+    { "CalcDestFast",               benchCalcDestFast,      1 },
+    { "CalcStepBatch(scalar)",      benchCalcStepScalar,    1 },
+    { "CalcStepBatch(SSE2)",        benchCalcStepSSE2,      1 },
+    { "CalcStepBatch(AVX2)",        benchCalcStepAVX2,      1 },
+    { "CFleet::Step(1 thread)",     benchFleetStep1,        1 },
+    { "CFleet::Step(4 threads)",    benchFleetStep4,        1 },
+    { "CalcAzimuth",                benchCalcAzimuth,       1 },
+    { "CAvgCar::updateAvg+calc",    benchAvgCar,            10 },
+    { "averageMachine::setSample",  benchAverageSetSample,  1 },
+    { "averageMachine::reCalc",     benchAverageReCalc,     10 },
+    { "WebsocketRecvQueue::push+pop", benchRecvQueue,       1 },
+    { "CConf::GetConfig",           benchGetConfig,         1 },
+};
+
+struct BenchResult
+{
+    const char *name;
+    long iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double cyclesPerOp;         // negative value: not available
+};
+
+/**
+ * @brief runBench
+ *        warm up, then measure one kernel
+ */
+static BenchResult runBench(const BenchCase &c, long iterations,
+                            CCycleCounter &cycle)
+{
+    long n = iterations / c.divisor;
+    if (n < 1) {
+        n = 1;
+    }
+    c.func(n / 10 + 1);
+
+    struct timespec t0, t1;
+    unsigned long a0 = g_nAlloc;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    cycle.Start();
+    c.func(n);
+    long long cycles = cycle.Stop();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    unsigned long a1 = g_nAlloc;
+
+    double ns = (double) (t1.tv_sec - t0.tv_sec) * 1000000000.0 +
+        (double) (t1.tv_nsec - t0.tv_nsec);
+
+    BenchResult r;
+    r.name = c.name;
+    r.iterations = n;
+    r.nsPerOp = ns / n;
+    r.allocsPerOp = (double) (a1 - a0) / n;
+    r.cyclesPerOp = (0 <= cycles) ? (double) cycles / n : -1.0;
+    return r;
+}
+
+/**
+ * @brief writeJson
+ *        save results, one object per kernel
+ */
+static bool writeJson(const char *path, const BenchResult *r, int cnt)
+{
+    FILE *fp = fopen(path, "w");
+    if (NULL == fp) {
+        perror(path);
+        return false;
+    }
+    struct utsname u;
+    memset(&u, 0, sizeof(u));
+    uname(&u);
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", VERSION);
+    fprintf(fp, "  \"machine\": \"%s\",\n", u.machine);
+    fprintf(fp, "  \"kernel\": \"%s\",\n", u.release);
+    fprintf(fp, "  \"time\": %ld,\n", (long) time(NULL));
+    fprintf(fp, "  \"results\": [\n");
+    for (int i = 0; i < cnt; i++) {
+        fprintf(fp, "    { \"name\": \"%s\", \"iterations\": %ld, "
+                "\"ns_per_op\": %.3f, \"allocs_per_op\": %.3f, "
+                "\"cycles_per_op\": ", r[i].name, r[i].iterations,
+                r[i].nsPerOp, r[i].allocsPerOp);
+        if (0.0 > r[i].cyclesPerOp) {
+            fprintf(fp, "null }");
+        }
+        else {
+            fprintf(fp, "%.1f }", r[i].cyclesPerOp);
+        }
+        fprintf(fp, "%s\n", (i + 1 < cnt) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return true;
+}
+
+/**
+ * @brief makeConf
+ *        configuration file with the layout of CarSim_Daemon.conf
+ */
+static bool makeConf(char *path, int size)
+{
+    snprintf(path, size, "/tmp/carsim_bench_XXXXXX");
+    int fd = mkstemp(path);
+    if (0 > fd) {
+        perror("mkstemp");
+        return false;
+    }
+    static const char conf[] =
+        "[HAZARDLAMP]\nTYPE=1\nNUMBER=3\n"
+        "[WINKER_RIGHT]\nTYPE=1\nNUMBER=6\n"
+        "[WINKER_LEFT]\nTYPE=1\nNUMBER=7\n"
+        "[AIRCON_TEMP]\nTYPE=2\nNUMBER=3\n"
+        "[SHIFT_UP]\nTYPE=1\nNUMBER=4\n"
+        "[SHIFT_DOWN]\nTYPE=1\nNUMBER=5\n"
+        "[HEAD_LIGHT]\nTYPE=1\nNUMBER=2\n"
+        "[STEERING]\nTYPE=2\nNUMBER=0\n"
+        "[ACCEL_BRAKE]\nTYPE=2\nNUMBER=1\n\n"
+        "[LASTPOSITION]\nLAT=35.717931\nLNG=139.736518\n\n"
+        "[RUNLOOP]\nTICK_HZ=100\nINTERVAL_HZ=20\n\n"
+        "[WEBSOCKET]\nBATCH=0\nCOMPACT=0\n";
+    bool b = (write(fd, conf, sizeof(conf) - 1) ==
+              (ssize_t) (sizeof(conf) - 1));
+    close(fd);
+    return b;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = D_BENCH_DEFAULT_ITERATIONS;
+    const char *jsonPath = NULL;
+    const char *confPath = NULL;
+    const char *filter = NULL;
+    int result = 0;
+
+    while ((result = getopt(argc, argv, "n:o:c:f:h")) != -1) {
+        switch (result) {
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 'o':
+            jsonPath = optarg;
+            break;
+        case 'c':
+            confPath = optarg;
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'h':
+        default:
+            printf("Usage: carsim_bench [-n iterations] [-o result.json] "
+                   "[-c conf] [-f name]\n");
+            printf("  -n\t iterations of light kernels(default %d)\n",
+                   D_BENCH_DEFAULT_ITERATIONS);
+            printf("  -o\t save results as JSON\n");
+            printf("  -c\t configuration file for CConf::GetConfig\n");
+            printf("  -f\t run kernels whose name contains the string\n");
+            return ('h' == result) ? 0 : 1;
+        }
+    }
+    if (0 >= iterations) {
+        printf("invalid iterations\n");
+        return 1;
+    }
+
+    bool tmpConf = false;
+    if (NULL != confPath) {
+        snprintf(g_confPath, sizeof(g_confPath), "%s", confPath);
+    }
+    else {
+        if (!makeConf(g_confPath, sizeof(g_confPath))) {
+            return 1;
+        }
+        tmpConf = true;
+    }
+
+    CCycleCounter cycle;
+    if (!cycle.isValid()) {
+        printf("CPU cycle counter is not available\n");
+    }
+
+    BenchResult results[D_BENCH_MAX_RESULTS];
+    int cnt = 0;
+    printf("%-32s %12s %12s %12s %12s\n", "kernel", "iterations",
+           "ns/op", "allocs/op", "cycles/op");
+    for (size_t i = 0; i < sizeof(g_cases) / sizeof(g_cases[0]); i++) {
+        if ((NULL != filter) && (NULL == strstr(g_cases[i].name, filter))) {
+            continue;
+        }
+        BenchResult r = runBench(g_cases[i], iterations, cycle);
+        if (0.0 > r.cyclesPerOp) {
+            printf("%-32s %12ld %12.1f %12.3f %12s\n", r.name,
+                   r.iterations, r.nsPerOp, r.allocsPerOp, "n/a");
+        }
+        else {
+            printf("%-32s %12ld %12.1f %12.3f %12.1f\n", r.name,
+                   r.iterations, r.nsPerOp, r.allocsPerOp, r.cyclesPerOp);
+        }
+        results[cnt++] = r;
+    }
+
+    if (tmpConf) {
+        unlink(g_confPath);
+    }
+    if ((NULL != jsonPath) && (!writeJson(jsonPath, results, cnt))) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * End of File.(CarSim_Bench.cpp)
+ */
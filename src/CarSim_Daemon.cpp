@@ -15,6 +15,7 @@
 #include <iostream>
 #include <unistd.h>
 #include <getopt.h>
+#include <stdlib.h>
 #include "CGtCtrl.h"
 using namespace std;
 
@@ -31,13 +32,37 @@ int main(int argc, char **argv)
     bool bTestMode = false;
     bool b;
     bool comFlg = false;
+    int nFleet = 0;
+    int nFleetThreads = 0;
+    const char *fleetScript = NULL;
+    bool bHeadless = false;
+    double dDuration = 0.0;
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    double dReplaySpeed = 1.0;
+    const char *vjsScript = NULL;
+    const char *vjsSocket = NULL;
 
     // parse command line
-    while ((result = getopt(argc, argv, "jhvgct")) != -1) {
+    while ((result = getopt(argc, argv, "jhvgctF:T:S:H:r:p:x:V:U:")) != -1) {
         switch (result) {
         case 'h':
-            printf("Usage: CarSim_Daemon [-g]\n");
+            printf("Usage: CarSim_Daemon [-g] [-H sec] "
+                   "[-r trace | -p trace [-x speed]] "
+                   "[-V script | -U socket] "
+                   "[-F vehicles [-T threads] [-S script]]\n");
             printf("  -g\t Get GPS form smartphone\n");
+            printf("  -H\t headless, virtual time as fast as possible, "
+                   "stop after sec(0: never)\n");
+            printf("  -r\t record joystick and route input to trace\n");
+            printf("  -p\t replay trace instead of the joystick\n");
+            printf("  -x\t replay speed of -p, 1: real time(default), "
+                   "0: as fast as possible\n");
+            printf("  -V\t drive script instead of the joystick\n");
+            printf("  -U\t joystick events from a UNIX socket\n");
+            printf("  -F\t simulate vehicles without joystick\n");
+            printf("  -T\t threads of -F (default: number of CPUs)\n");
+            printf("  -S\t input script of -F (default: random inputs)\n");
             return 0;
             break;
         case 'v':
@@ -57,11 +82,78 @@ int main(int argc, char **argv)
         case 'j':
             gbDevJs = true;
             break;
+        case 'F':
+            nFleet = atoi(optarg);
+            break;
+        case 'T':
+            nFleetThreads = atoi(optarg);
+            break;
+        case 'S':
+            fleetScript = optarg;
+            break;
+        case 'H':
+            bHeadless = true;
+            dDuration = atof(optarg);
+            break;
+        case 'r':
+            recordPath = optarg;
+            break;
+        case 'p':
+            replayPath = optarg;
+            break;
+        case 'x':
+            dReplaySpeed = atof(optarg);
+            break;
+        case 'V':
+            vjsScript = optarg;
+            break;
+        case 'U':
+            vjsSocket = optarg;
+            break;
+        }
+    }
+
+    if ((NULL != replayPath) && (bHeadless || (NULL != recordPath))) {
+        printf("-p can not be used with -H or -r\n");
+        return 1;
+    }
+    if ((NULL != vjsScript) && (NULL != vjsSocket)) {
+        printf("-V can not be used with -U\n");
+        return 1;
+    }
+
+    if (0 < nFleet) {
+        CGtCtrl myGtCtrl;
+        if (bHeadless) {
+            myGtCtrl.SetHeadless(dDuration);
+        }
+        myGtCtrl.SetFleet(nFleet, nFleetThreads, fleetScript);
+        b = myGtCtrl.Initialize();
+        if (b) {
+            myGtCtrl.RunFleet();
         }
+        myGtCtrl.Terminate();
+        return 0;
     }
 
     if (comFlg) {
         CGtCtrl myGtCtrl;
+        if (bHeadless) {
+            myGtCtrl.SetHeadless(dDuration);
+        }
+        if (NULL != vjsScript) {
+            myGtCtrl.SetVirtualJoyStick(CJoyStickVirtual::SCRIPT, vjsScript);
+        }
+        if (NULL != vjsSocket) {
+            myGtCtrl.SetVirtualJoyStick(CJoyStickVirtual::SOCKET, vjsSocket);
+        }
+        if (NULL != recordPath) {
+            myGtCtrl.SetRecord(recordPath);
+        }
+        if ((NULL != replayPath) &&
+            (!myGtCtrl.SetReplay(replayPath, dReplaySpeed))) {
+            return 1;
+        }
 
         b = myGtCtrl.Initialize();
 
@@ -103,6 +195,22 @@ int main(int argc, char **argv)
     }
     else {
         CGtCtrl myGtCtrl;
+        if (bHeadless) {
+            myGtCtrl.SetHeadless(dDuration);
+        }
+        if (NULL != vjsScript) {
+            myGtCtrl.SetVirtualJoyStick(CJoyStickVirtual::SCRIPT, vjsScript);
+        }
+        if (NULL != vjsSocket) {
+            myGtCtrl.SetVirtualJoyStick(CJoyStickVirtual::SOCKET, vjsSocket);
+        }
+        if (NULL != recordPath) {
+            myGtCtrl.SetRecord(recordPath);
+        }
+        if ((NULL != replayPath) &&
+            (!myGtCtrl.SetReplay(replayPath, dReplaySpeed))) {
+            return 1;
+        }
         b = myGtCtrl.Initialize();
 
         if (b) {
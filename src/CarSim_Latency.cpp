@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2013, TOYOTA MOTOR CORPORATION.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+/**
+ * @file    CarSim_Latency.cpp
+ * @brief   end-to-end input latency of carsim
+ *
+ *          creates a "Driving Force GT" through /dev/uinput with the axes
+ *          and buttons CJoyStickEV expects, listens on the AMB ports in
+ *          place of ambd (CAmbServer) and measures the time from writing
+ *          an input event to the arrival of the STEERING / VELOCITY
+ *          record it causes. start carsim after this tool is waiting.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/utsname.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <vector>
+#include <algorithm>
+#include "CAmbServer.h"
+#include "CEventLoop.h"
+
+#define VERSION "0.1.2"
+
+#define D_LAT_DEVICE_NAME       "Driving Force GT"
+#define D_LAT_DEFAULT_SAMPLES   200
+#define D_LAT_DEFAULT_INTERVAL  100     // [ms]
+#define D_LAT_DEFAULT_TIMEOUT   1000    // [ms]
+#define D_LAT_DEFAULT_SHIFTD    5       // SHIFT_DOWN of CarSim_Daemon.conf
+#define D_LAT_SETTLE            1000    // [ms] after carsim connected
+
+/* absinfo CJoyStickEV falls back to, so the conversion is the same */
+#define D_LAT_ABSX_MAX          1023
+#define D_LAT_ABSY_MAX          255
+
+static volatile bool g_bStop = false;
+
+static void signalHandler(int /*signo*/)
+{
+    g_bStop = true;
+}
+
+/******************************************
+ * synthetic joystick
+******************************************/
+class CUinputJoyStick
+{
+  public:
+            CUinputJoyStick();
+            ~CUinputJoyStick();
+    bool    Create();
+    void    Destroy();
+    bool    Abs(int code, int value, struct timespec *ts);
+    bool    Button(int number, int value, struct timespec *ts);
+  private:
+    bool    emit(int type, int code, int value);
+    int     m_fd;
+};
+
+CUinputJoyStick::CUinputJoyStick()
+{
+    m_fd = -1;
+}
+
+CUinputJoyStick::~CUinputJoyStick()
+{
+    Destroy();
+}
+
+/**
+ * @brief Create
+ *        ABS_X, ABS_Y, ABS_HAT0X/Y and the buttons BTN_JOYSTICK ..
+ *        BTN_GEAR_UP, the range CJoyStickEV converts
+ * @return true:success false:failure
+ */
+bool CUinputJoyStick::Create()
+{
+    m_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (0 > m_fd) {
+        perror("/dev/uinput");
+        return false;
+    }
+    struct uinput_user_dev dev;
+    memset(&dev, 0, sizeof(dev));
+    snprintf(dev.name, sizeof(dev.name), "%s", D_LAT_DEVICE_NAME);
+    dev.id.bustype = BUS_VIRTUAL;
+    dev.absmax[ABS_X] = D_LAT_ABSX_MAX;
+    dev.absmax[ABS_Y] = D_LAT_ABSY_MAX;
+    dev.absmin[ABS_HAT0X] = -1;
+    dev.absmax[ABS_HAT0X] = 1;
+    dev.absmin[ABS_HAT0Y] = -1;
+    dev.absmax[ABS_HAT0Y] = 1;
+
+    bool b = (0 <= ioctl(m_fd, UI_SET_EVBIT, EV_KEY)) &&
+        (0 <= ioctl(m_fd, UI_SET_EVBIT, EV_ABS)) &&
+        (0 <= ioctl(m_fd, UI_SET_EVBIT, EV_SYN)) &&
+        (0 <= ioctl(m_fd, UI_SET_ABSBIT, ABS_X)) &&
+        (0 <= ioctl(m_fd, UI_SET_ABSBIT, ABS_Y)) &&
+        (0 <= ioctl(m_fd, UI_SET_ABSBIT, ABS_HAT0X)) &&
+        (0 <= ioctl(m_fd, UI_SET_ABSBIT, ABS_HAT0Y));
+    for (int code = BTN_JOYSTICK; b && (code <= BTN_GEAR_UP); code++) {
+        b = (0 <= ioctl(m_fd, UI_SET_KEYBIT, code));
+    }
+    b = b && (sizeof(dev) == write(m_fd, &dev, sizeof(dev))) &&
+        (0 <= ioctl(m_fd, UI_DEV_CREATE));
+    if (!b) {
+        perror("uinput setup");
+        Destroy();
+        return false;
+    }
+    return true;
+}
+
+void CUinputJoyStick::Destroy()
+{
+    if (0 > m_fd) {
+        return;
+    }
+    ioctl(m_fd, UI_DEV_DESTROY);
+    close(m_fd);
+    m_fd = -1;
+}
+
+bool CUinputJoyStick::emit(int type, int code, int value)
+{
+    struct input_event ie;
+    memset(&ie, 0, sizeof(ie));
+    ie.type = type;
+    ie.code = code;
+    ie.value = value;
+    return (sizeof(ie) == write(m_fd, &ie, sizeof(ie)));
+}
+
+/**
+ * @brief Abs
+ *        move an axis
+ * @param ts CLOCK_MONOTONIC just before the event was written
+ */
+bool CUinputJoyStick::Abs(int code, int value, struct timespec *ts)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    return emit(EV_ABS, code, value) && emit(EV_SYN, SYN_REPORT, 0);
+}
+
+/**
+ * @brief Button
+ *        press(1) or release(0) a button, number as in CarSim_Daemon.conf
+ * @param ts CLOCK_MONOTONIC just before the event was written
+ */
+bool CUinputJoyStick::Button(int number, int value, struct timespec *ts)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    return emit(EV_KEY, BTN_JOYSTICK + number, value) &&
+        emit(EV_SYN, SYN_REPORT, 0);
+}
+
+/******************************************
+ * measurement
+******************************************/
+struct LatencyProbe
+{
+    const char *key;            // STEERING / VELOCITY
+    bool pending;               // waiting for the record of an input
+    int expect;                 // >0: value > 0, <0: value < 0, 0: any
+    struct timespec inject;
+    bool matched;
+    double latency;             // [ms]
+    int lastValue;              // latest value of key
+};
+
+static void onRecord(const AmbRecord *rec, void *arg)
+{
+    LatencyProbe *p = reinterpret_cast < LatencyProbe * >(arg);
+    if ((NULL == rec->name) || (0 != strcmp(rec->name, p->key)) ||
+        ((int) sizeof(int) > rec->size)) {
+        return;
+    }
+    int value;
+    memcpy(&value, rec->status, sizeof(value));
+    p->lastValue = value;
+    if ((!p->pending) || p->matched) {
+        return;
+    }
+    if (((0 < p->expect) && (0 >= value)) ||
+        ((0 > p->expect) && (0 <= value))) {
+        return;
+    }
+    p->matched = true;
+    p->latency = (double) (rec->recv.tv_sec - p->inject.tv_sec) * 1000.0 +
+        (double) (rec->recv.tv_nsec - p->inject.tv_nsec) / 1000000.0;
+}
+
+static double elapsedMs(const struct timespec *t0)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double) (t1.tv_sec - t0->tv_sec) * 1000.0 +
+        (double) (t1.tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+/**
+ * @brief pump
+ *        serve the websocket sockets for ms, or until done is set
+ */
+static bool pump(CEventLoop &loop, int ms, const bool *done)
+{
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (!g_bStop) {
+        if ((NULL != done) && (*done)) {
+            return true;
+        }
+        int left = ms - (int) elapsedMs(&t0);
+        if (0 >= left) {
+            return (NULL == done);
+        }
+        if (0 > loop.Dispatch(left)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static double percentile(const std::vector<double> &v, double p)
+{
+    if (v.empty()) {
+        return 0.0;
+    }
+    size_t i = (size_t) (p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+static bool parsePorts(const char *s, int port[D_AMB_PORTS])
+{
+    return (D_AMB_PORTS == sscanf(s, "%d,%d,%d,%d", &port[0], &port[1],
+                                  &port[2], &port[3]));
+}
+
+int main(int argc, char **argv)
+{
+    int port[D_AMB_PORTS] = { 0, 0, 0, 0 };
+    bool bPorts = false;
+    bool bVelocity = false;
+    bool bCompact = false;
+    int samples = D_LAT_DEFAULT_SAMPLES;
+    int interval = D_LAT_DEFAULT_INTERVAL;
+    int timeout = D_LAT_DEFAULT_TIMEOUT;
+    int shiftDown = D_LAT_DEFAULT_SHIFTD;
+    const char *jsonPath = NULL;
+    int result = 0;
+
+    while ((result = getopt(argc, argv, "P:k:n:i:t:d:o:Ch")) != -1) {
+        switch (result) {
+        case 'P':
+            bPorts = parsePorts(optarg, port);
+            break;
+        case 'k':
+            bVelocity = (0 == strcmp(optarg, "velocity"));
+            break;
+        case 'n':
+            samples = atoi(optarg);
+            break;
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        case 't':
+            timeout = atoi(optarg);
+            break;
+        case 'd':
+            shiftDown = atoi(optarg);
+            break;
+        case 'o':
+            jsonPath = optarg;
+            break;
+        case 'C':
+            bCompact = true;
+            break;
+        case 'h':
+        default:
+            printf("Usage: carsim_latency -P port,port,port,port "
+                   "[-k steering|velocity] [-n samples] [-i ms] [-t ms] "
+                   "[-d button] [-o result.json] [-C]\n");
+            printf("  -P\t DataPort,CtrlPort of DefaultInfoPort and "
+                   "CustomizeInfoPort(AMB config)\n");
+            printf("  -k\t record to wait for(default steering)\n");
+            printf("  -n\t samples(default %d)\n", D_LAT_DEFAULT_SAMPLES);
+            printf("  -i\t interval between samples(default %dms)\n",
+                   D_LAT_DEFAULT_INTERVAL);
+            printf("  -t\t sample is lost after(default %dms)\n",
+                   D_LAT_DEFAULT_TIMEOUT);
+            printf("  -d\t SHIFT_DOWN button of CarSim_Daemon.conf"
+                   "(default %d)\n", D_LAT_DEFAULT_SHIFTD);
+            printf("  -o\t save results as JSON\n");
+            printf("  -C\t acknowledge the compact format\n");
+            return ('h' == result) ? 0 : 1;
+        }
+    }
+    if ((!bPorts) || (0 >= samples) || (0 >= interval) || (0 >= timeout)) {
+        printf("invalid arguments, see -h\n");
+        return 1;
+    }
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    LatencyProbe probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.key = bVelocity ? "VELOCITY" : "STEERING";
+
+    CUinputJoyStick js;
+    CEventLoop loop;
+    CAmbServer amb;
+    if ((!js.Create()) || (!loop.Open()) ||
+        (!amb.Start(port, &loop, onRecord, &probe, bCompact))) {
+        return 1;
+    }
+    struct timespec ts;
+    js.Abs(ABS_X, D_LAT_ABSX_MAX / 2, &ts);
+    js.Abs(ABS_Y, D_LAT_ABSY_MAX / 2, &ts);
+
+    printf("%s created, waiting for carsim on ports %d,%d,%d,%d...\n",
+           D_LAT_DEVICE_NAME, port[0], port[1], port[2], port[3]);
+    while ((!g_bStop) && (!amb.IsAllConnected())) {
+        if (0 > loop.Dispatch(100)) {
+            return 1;
+        }
+    }
+    pump(loop, D_LAT_SETTLE, NULL);
+
+    if (bVelocity) {
+        /* PARKING -> REVERSE -> NEUTRAL -> DRIVE */
+        for (int i = 0; i < 3; i++) {
+            js.Button(shiftDown, 1, &ts);
+            pump(loop, 50, NULL);
+            js.Button(shiftDown, 0, &ts);
+            pump(loop, 50, NULL);
+        }
+    }
+
+    std::vector<double> lat;
+    lat.reserve(samples);
+    int lost = 0;
+    for (int i = 0; (i < samples) && (!g_bStop); i++) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        probe.matched = false;
+        probe.pending = true;
+        if (bVelocity) {
+            /* full throttle from a stop, wait for the first speed */
+            probe.expect = 1;
+            js.Abs(ABS_Y, 0, &probe.inject);
+        }
+        else {
+            /* full lock, alternating, so every sample changes STEERING */
+            probe.expect = (0 == (i & 1)) ? 1 : -1;
+            js.Abs(ABS_X, (0 < probe.expect) ? D_LAT_ABSX_MAX : 0,
+                   &probe.inject);
+        }
+        pump(loop, timeout, &probe.matched);
+        probe.pending = false;
+        if (probe.matched) {
+            lat.push_back(probe.latency);
+        }
+        else {
+            lost++;
+        }
+        if (bVelocity) {
+            /* brake to a stop, release, not measured */
+            js.Abs(ABS_Y, D_LAT_ABSY_MAX, &ts);
+            struct timespec tb;
+            clock_gettime(CLOCK_MONOTONIC, &tb);
+            while ((!g_bStop) && (0 != probe.lastValue) &&
+                   (elapsedMs(&tb) < timeout * 10)) {
+                pump(loop, 10, NULL);
+            }
+            js.Abs(ABS_Y, D_LAT_ABSY_MAX / 2, &ts);
+        }
+        int left = interval - (int) elapsedMs(&t0);
+        if (0 < left) {
+            pump(loop, left, NULL);
+        }
+    }
+
+    std::sort(lat.begin(), lat.end());
+    double p50 = percentile(lat, 0.50);
+    double p99 = percentile(lat, 0.99);
+    double max = lat.empty() ? 0.0 : lat.back();
+    printf("%s: samples=%d lost=%d p50=%.3fms p99=%.3fms max=%.3fms\n",
+           probe.key, (int) lat.size(), lost, p50, p99, max);
+
+    if (NULL != jsonPath) {
+        FILE *fp = fopen(jsonPath, "w");
+        if (NULL == fp) {
+            perror(jsonPath);
+            return 1;
+        }
+        struct utsname u;
+        memset(&u, 0, sizeof(u));
+        uname(&u);
+        fprintf(fp, "{\n");
+        fprintf(fp, "  \"version\": \"%s\",\n", VERSION);
+        fprintf(fp, "  \"machine\": \"%s\",\n", u.machine);
+        fprintf(fp, "  \"kernel\": \"%s\",\n", u.release);
+        fprintf(fp, "  \"time\": %ld,\n", (long) time(NULL));
+        fprintf(fp, "  \"key\": \"%s\",\n", probe.key);
+        fprintf(fp, "  \"samples\": %d,\n", (int) lat.size());
+        fprintf(fp, "  \"lost\": %d,\n", lost);
+        fprintf(fp, "  \"p50_ms\": %.3f,\n", p50);
+        fprintf(fp, "  \"p99_ms\": %.3f,\n", p99);
+        fprintf(fp, "  \"max_ms\": %.3f\n", max);
+        fprintf(fp, "}\n");
+        fclose(fp);
+    }
+    amb.Stop();
+    loop.Close();
+    js.Destroy();
+    return 0;
+}
+
+/**
+ * End of File.(CarSim_Latency.cpp)
+ */
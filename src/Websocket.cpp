@@ -12,128 +12,228 @@
  */
 
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 
 #include <iostream>
+#include <vector>
 
 #include "Websocket.h"
 
+/**
+ * open transports, to find the transport of a context in pollfd().
+ * pending is the one creating its context right now.
+ */
+static std::vector<WebsocketTransport *> extpollTransports;
+static WebsocketTransport *extpollPending = NULL;
+
+/**
+ * started connections, to find the connection of a callback
+ */
+static std::vector<WebsocketIF *> extpollInstances;
+
 WebsocketRecvQueue::WebsocketRecvQueue()
-: msize(0), maxqueuesize(10)
 {
-    init();
+    init(10);
 }
 
 WebsocketRecvQueue::WebsocketRecvQueue(int queuesize)
-: msize(0)
 {
-    maxqueuesize = queuesize;
-    init();
+    init(queuesize);
 }
 
 WebsocketRecvQueue::~WebsocketRecvQueue()
 {
     delete[] mdata;
     delete[] mdatasize;
+    if (efd >= 0) {
+        close(efd);
+    }
 }
 
 bool WebsocketRecvQueue::push(char *data, int datasize)
 {
-    if (datasize > maxdatasize || (msize + 1) > maxqueuesize) {
+    if (datasize > maxdatasize || datasize < 0) {
+        oversize++;
         return false;
     }
-    memset(mdata[msize], 0, maxdatasize);
-    memcpy(mdata[msize], data, datasize);
-    mdatasize[msize] = datasize;
-    msize++;
+    unsigned int t = tail;
+    unsigned int h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    if ((t - h) >= capacity) {
+        overflow++;
+        return false;
+    }
+    memcpy(mdata[t & mask], data, datasize);
+    mdatasize[t & mask] = datasize;
+    /**
+     * seq_cst store of tail and load of waiting pair with the store of
+     * waiting and load of tail in wait(): either the consumer sees the
+     * new tail or the producer sees it waiting
+     */
+    __atomic_store_n(&tail, t + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiting, __ATOMIC_SEQ_CST)) {
+        /* wake up the consumer blocked in wait() */
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one)) < 0) {
+            /* counter saturated, consumer is awake anyway */
+        }
+    }
     return true;
 }
 
 bool WebsocketRecvQueue::front(char *buf) const
 {
-    if (msize == 0) {
+    unsigned int h = head;
+    if (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) == h) {
         return false;
     }
-    memcpy(buf, mdata[0], mdatasize[0]);
+    memcpy(buf, mdata[h & mask], mdatasize[h & mask]);
     return true;
 }
 
 bool WebsocketRecvQueue::empty() const
 {
-    return (msize == 0);
+    return (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) == head);
 }
 
 void WebsocketRecvQueue::pop()
 {
-    if (msize > 0) {
-        msize--;
-        for (int i = 0; i < msize; i++) {
-            memset(mdata[i], 0, maxdatasize);
-            memcpy(mdata[i], mdata[i + 1], mdatasize[i + 1]);
-            mdatasize[i] = mdatasize[i + 1];
-        }
-        memset(mdata[msize], 0, maxdatasize);
-        mdatasize[msize] = 0;
+    unsigned int h = head;
+    if (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) != h) {
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
     }
 }
 
 int WebsocketRecvQueue::size() const
 {
-    return msize;
+    return (int) (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) -
+                  __atomic_load_n(&head, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief block until the queue is not empty (consumer side)
+ * @return true:not empty false:error
+ */
+bool WebsocketRecvQueue::wait()
+{
+    while (empty()) {
+        __atomic_store_n(&waiting, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) != head) {
+            __atomic_store_n(&waiting, false, __ATOMIC_RELAXED);
+            break;
+        }
+        /* a stale count only makes the loop check once more */
+        uint64_t cnt;
+        ssize_t n = read(efd, &cnt, sizeof(cnt));
+        __atomic_store_n(&waiting, false, __ATOMIC_RELAXED);
+        if ((n < 0) && (errno != EINTR)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief eventfd signalled for a consumer blocked in wait()
+ */
+int WebsocketRecvQueue::getfd() const
+{
+    return efd;
 }
 
-void WebsocketRecvQueue::init()
+unsigned long WebsocketRecvQueue::overflowCount() const
 {
-    mdata = new char[maxqueuesize][maxdatasize];
-    memset((void *) mdata, 0, maxqueuesize * maxdatasize);
+    return overflow;
+}
 
-    mdatasize = new int[maxqueuesize];
+unsigned long WebsocketRecvQueue::oversizeCount() const
+{
+    return oversize;
+}
 
-    memset(mdatasize, 0, maxqueuesize);
+void WebsocketRecvQueue::init(int queuesize)
+{
+    capacity = 1;
+    while ((int) capacity < queuesize) {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    head = 0;
+    waiting = false;
+    tail = 0;
+    overflow = 0;
+    oversize = 0;
+
+    mdata = new char[capacity][maxdatasize];
+    mdatasize = new int[capacity];
+
+    efd = eventfd(0, EFD_CLOEXEC);
+    if (efd < 0) {
+        std::cerr << "Failed to create eventfd." << std::endl;
+    }
 }
 
 WebsocketIF::WebsocketIF()
-:  isready(false), threadid(0)
+:  isready(false), eventloop(NULL), transport(NULL), owntransport(false),
+context(NULL), websocket(NULL), sendbuf(NULL), sendbufsize(0), nsend(0),
+ncopy(0), nalloc(0), batch(false), batchcount(0), batchlen(0), batchrec(0),
+sendqmax(0), ncoalesce(0), ndrop(0), connport(0), protoname(NULL),
+connected(false), sockfd(-1), pending(0), nconnect(0), ndisconnect(0),
+recoverms(0.0), recovermax(0.0), firstms(0.0), attemptms(attemptdefault)
 {
+    pthread_mutex_init(&sendqlock, NULL);
 }
 
 WebsocketIF::WebsocketIF(int port, char *interface,
                          libwebsocket_protocols * protocols,
                          pthread_mutex_t * mtx,
-                         pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue)
-:threadid(0), mutex(mtx), cond(cnd), queue(recvqueue)
+                         pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue,
+                         CEventLoop * evloop)
+:eventloop(evloop), transport(NULL), owntransport(false), context(NULL),
+websocket(NULL), mutex(mtx), cond(cnd), sendbuf(NULL), sendbufsize(0),
+nsend(0), ncopy(0), nalloc(0), batch(false), batchcount(0), batchlen(0),
+batchrec(0), queue(recvqueue), sendqmax(0), ncoalesce(0), ndrop(0),
+connport(0), protoname(NULL), connected(false), sockfd(-1), pending(0),
+nconnect(0), ndisconnect(0), recoverms(0.0), recovermax(0.0), firstms(0.0),
+attemptms(attemptdefault)
 {
+    pthread_mutex_init(&sendqlock, NULL);
     isready = init(port, interface, protocols, mtx, cnd, recvqueue);
 }
 
 WebsocketIF::~WebsocketIF()
 {
-    if (isready) {
-        int ret;
-        if (threadid != 0) {
-            ret = pthread_cancel(threadid);
-            if (ret != 0) {
-                std::cerr << "Failed to pthread_cancel" << std::endl;
-            }
-        }
-        ret = pthread_join(threadid, NULL);
-        if (ret != 0) {
-            std::cerr << "Failed to pthread_join" << std::endl;
-        }
-        if (context != NULL) {
-            libwebsocket_context_destroy(context);
-            context = NULL;
+    /* a shared transport closes the connection when it is closed */
+    if (owntransport) {
+        delete transport;       // service thread stopped first
+    }
+    transport = NULL;
+    for (size_t i = 0; i < extpollInstances.size(); i++) {
+        if (extpollInstances[i] == this) {
+            extpollInstances.erase(extpollInstances.begin() + i);
+            break;
         }
     }
+    context = NULL;
+    delete[] sendbuf;
+    pthread_mutex_destroy(&sendqlock);
 }
 
 bool WebsocketIF::start(int port, char *interface,
                         libwebsocket_protocols * protocols,
                         pthread_mutex_t * mtx,
-                        pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue)
+                        pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue,
+                        CEventLoop * evloop)
 {
     if (isready) {
         return isready;
     }
+    eventloop = evloop;
     mutex = mtx;
     cond = cnd;
     queue = recvqueue;
@@ -141,20 +241,604 @@ bool WebsocketIF::start(int port, char *interface,
     return isready;
 }
 
-bool WebsocketIF::send(char *msg, int size)
+/**
+ * @brief connect on a shared transport
+ * @param tp        transport, open, its protocol array has protocol
+ * @param port      server port
+ * @param protocol  protocol name
+ * @param recvqueue queue of the received messages of this protocol
+ * @return true:success false:failure
+ */
+bool WebsocketIF::start(WebsocketTransport * tp, int port,
+                        const char *protocol, pthread_mutex_t * mtx,
+                        pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue)
 {
-    if (!isready) {
+    if (isready) {
         return isready;
     }
+    if ((tp == NULL) || (tp->getContext() == NULL)) {
+        return false;
+    }
+    transport = tp;
+    owntransport = false;
+    eventloop = tp->getEventLoop();
+    context = tp->getContext();
+    mutex = mtx;
+    cond = cnd;
+    queue = recvqueue;
+    isready = connect(port, protocol);
+    return isready;
+}
 
-    char *buf;
-    memset(sendbuf, 0, sizeof(sendbuf));
-    buf = &sendbuf[LWS_SEND_BUFFER_PRE_PADDING];
+/**
+ * @brief write a complete message now
+ *        (batch mode: records batched so far are flushed first)
+ * @param msg   message
+ * @param size  size of message
+ * @return true:success false:failure
+ */
+bool WebsocketIF::send(char *msg, int size)
+{
+    if (!isready || size < 0) {
+        return false;
+    }
+    if (batch && !flush()) {
+        return false;
+    }
+    char *buf = grow(size);
     memcpy(buf, msg, size);
-    int ret = libwebsocket_write(websocket,
-                                 reinterpret_cast < unsigned char *>(buf),
-                                 size, LWS_WRITE_BINARY);
-    return (ret == 0);
+    ncopy++;
+    return write(size, -1);
+}
+
+/**
+ * @brief get the payload area of the send buffer
+ * @param size  size of message to be built
+ * @return payload area(LWS_SEND_BUFFER_PRE_PADDING is in front of it),
+ *         NULL if not connected
+ */
+char *WebsocketIF::reserve(int size)
+{
+    if (!isready || size < 0) {
+        return NULL;
+    }
+    int off = 0;
+    int need = size;
+    if (batch) {
+        off = (batchcount == 0) ? KEYDATA_BATCH_HDRSIZE : batchlen;
+        need = KEYDATA_BATCH_ALIGN(off + KEYDATA_BATCH_RECHDRSIZE + size);
+        off += KEYDATA_BATCH_RECHDRSIZE;
+    }
+    char *frame = grow(need);
+    batchrec = off;
+    return &frame[off];
+}
+
+/**
+ * @brief write the message built in the reserve() area
+ *        (batch mode: append it to the frame, written by flush())
+ * @param size  size of message
+ * @param key   queued message of the same key is replaced, -1: none
+ * @return true:written or queued false:failure
+ */
+bool WebsocketIF::commit(int size, int key)
+{
+    if (!isready || size < 0 || batchrec + size > sendbufsize) {
+        return false;
+    }
+    if (batch) {
+        char *frame = &sendbuf[LWS_SEND_BUFFER_PRE_PADDING];
+        int rec = batchrec - KEYDATA_BATCH_RECHDRSIZE;
+        uint32_t hdr[2] = { (uint32_t) size, 0 };
+        memcpy(&frame[rec], hdr, sizeof(hdr));
+        batchlen = KEYDATA_BATCH_ALIGN(batchrec + size);
+        batchcount++;
+        return true;
+    }
+    return write(size, key);
+}
+
+/**
+ * @brief switch batch mode
+ *        records not flushed yet are dropped
+ */
+void WebsocketIF::setBatch(bool enable)
+{
+    batch = enable;
+    batchcount = 0;
+    batchlen = 0;
+    batchrec = 0;
+}
+
+/**
+ * @brief write the batched frame
+ * @return true:success or nothing to write false:failure
+ */
+bool WebsocketIF::flush()
+{
+    if (!batch || batchcount == 0) {
+        return true;
+    }
+    char *frame = &sendbuf[LWS_SEND_BUFFER_PRE_PADDING];
+    uint32_t cnt = (uint32_t) batchcount;
+    memcpy(&frame[0], KEYDATA_BATCH_MAGIC, 4);
+    memcpy(&frame[4], &cnt, sizeof(cnt));
+    int len = batchlen;
+    batchcount = 0;
+    batchlen = 0;
+    if (!isready) {
+        return false;
+    }
+    return write(len, -1);
+}
+
+/**
+ * @brief make the payload area of the send buffer large enough
+ *        (a batch frame being built is kept)
+ * @param need  payload size
+ * @return payload area
+ */
+char *WebsocketIF::grow(int need)
+{
+    if (need > sendbufsize) {
+        int newsize = sendbufsize > 0 ? sendbufsize :
+                      WebsocketRecvQueue::maxdatasize;
+        while (newsize < need) {
+            newsize *= 2;
+        }
+        char *newbuf = new char[LWS_SEND_BUFFER_PRE_PADDING + newsize +
+                                LWS_SEND_BUFFER_POST_PADDING];
+        if (batch && batchcount > 0) {
+            memcpy(&newbuf[LWS_SEND_BUFFER_PRE_PADDING],
+                   &sendbuf[LWS_SEND_BUFFER_PRE_PADDING], batchlen);
+        }
+        delete[] sendbuf;
+        sendbuf = newbuf;
+        sendbufsize = newsize;
+        nalloc++;
+    }
+    return &sendbuf[LWS_SEND_BUFFER_PRE_PADDING];
+}
+
+/**
+ * @brief write payload area of the send buffer to the socket, or queue
+ *        it if the socket cannot take it now
+ * @param len   size of payload
+ * @param key   queued frame of the same key is replaced, -1: none
+ * @return true:written or queued false:failure
+ */
+bool WebsocketIF::write(int len, int key)
+{
+    if (!isConnected()) {
+        return false;
+    }
+    if (eventloop != NULL) {
+        pthread_mutex_lock(&sendqlock);
+        bool direct = sendq.empty();
+        pthread_mutex_unlock(&sendqlock);
+        if (direct && writable()) {
+            int ret = libwebsocket_write(websocket,
+                                         reinterpret_cast < unsigned char *>
+                                         (&sendbuf
+                                          [LWS_SEND_BUFFER_PRE_PADDING]),
+                                         len, LWS_WRITE_BINARY);
+            nsend++;
+            return (ret == 0);
+        }
+    }
+    return enqueue(len, key);
+}
+
+/**
+ * @brief copy payload area of the send buffer to the send queue
+ * @param len   size of payload
+ * @param key   queued frame of the same key is replaced, -1: none
+ * @return true:queued false:queue full
+ */
+bool WebsocketIF::enqueue(int len, int key)
+{
+    const char *payload = &sendbuf[LWS_SEND_BUFFER_PRE_PADDING];
+    pthread_mutex_lock(&sendqlock);
+    if (key >= 0) {
+        for (size_t i = 0; i < sendq.size(); i++) {
+            SendFrame &f = sendq[i];
+            if (f.key == key) {
+                f.buf.resize(LWS_SEND_BUFFER_PRE_PADDING + len +
+                             LWS_SEND_BUFFER_POST_PADDING);
+                memcpy(&f.buf[LWS_SEND_BUFFER_PRE_PADDING], payload, len);
+                f.len = len;
+                ncoalesce++;
+                pthread_mutex_unlock(&sendqlock);
+                return true;
+            }
+        }
+    }
+    if ((int) sendq.size() >= sendqmaxsize) {
+        ndrop++;
+        pthread_mutex_unlock(&sendqlock);
+        return false;
+    }
+    sendq.push_back(SendFrame());
+    SendFrame &f = sendq.back();
+    f.key = key;
+    f.len = len;
+    f.buf.resize(LWS_SEND_BUFFER_PRE_PADDING + len +
+                 LWS_SEND_BUFFER_POST_PADDING);
+    memcpy(&f.buf[LWS_SEND_BUFFER_PRE_PADDING], payload, len);
+    if ((int) sendq.size() > sendqmax) {
+        sendqmax = (int) sendq.size();
+    }
+    pthread_mutex_unlock(&sendqlock);
+    request(REQ_WRITABLE);
+    return true;
+}
+
+/**
+ * @brief check the socket can take more data without blocking
+ * @return true:writable
+ */
+bool WebsocketIF::writable() const
+{
+    struct pollfd pfd;
+    pfd.fd = libwebsocket_get_socket_fd(websocket);
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    return ((::poll(&pfd, 1, 0) == 1) && (pfd.revents & POLLOUT));
+}
+
+/**
+ * @brief write queued frames while the socket is writable
+ *        (LWS_CALLBACK_CLIENT_WRITEABLE)
+ */
+void WebsocketIF::drain()
+{
+    pthread_mutex_lock(&sendqlock);
+    while (isConnected() && !sendq.empty()) {
+        SendFrame &f = sendq.front();
+        int ret = libwebsocket_write(websocket,
+                                     reinterpret_cast < unsigned char *>
+                                     (&f.buf[LWS_SEND_BUFFER_PRE_PADDING]),
+                                     f.len, LWS_WRITE_BINARY);
+        nsend++;
+        if (ret != 0) {
+            ndrop++;
+        }
+        sendq.pop_front();
+        if (!sendq.empty() && !writable()) {
+            libwebsocket_callback_on_writable(context, websocket);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sendqlock);
+}
+
+/**
+ * @brief the socket of a connection became writable
+ *        (forwarded LWS_CALLBACK_CLIENT_WRITEABLE)
+ * @param context   context that owns the socket
+ * @param wsi       connection
+ */
+void WebsocketIF::writeable(libwebsocket_context * context,
+                            libwebsocket * wsi)
+{
+    WebsocketIF *src = find(context, wsi);
+    if (src != NULL) {
+        src->drain();
+    }
+}
+
+/**
+ * @brief a connection was established
+ *        (forwarded LWS_CALLBACK_CLIENT_ESTABLISHED)
+ * @param context   context that owns the connection
+ * @param wsi       connection
+ * @return true:owned false:abandoned attempt, the callback closes it
+ */
+bool WebsocketIF::established(libwebsocket_context * context,
+                              libwebsocket * wsi)
+{
+    WebsocketIF *src = find(context, wsi);
+    if (src == NULL) {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (src->nconnect == 0) {
+        src->firstms = (double) (now.tv_sec - src->starttime.tv_sec) *
+            1000.0 + (double) (now.tv_nsec - src->starttime.tv_nsec) /
+            1000000.0;
+    }
+    src->websocket = wsi;
+    __atomic_store_n(&src->sockfd, libwebsocket_get_socket_fd(wsi),
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&src->connected, true, __ATOMIC_RELEASE);
+    src->nconnect++;
+    if (src->ndisconnect > 0) {
+        src->recoverms = (double) (now.tv_sec - src->downtime.tv_sec) *
+            1000.0 + (double) (now.tv_nsec - src->downtime.tv_nsec) /
+            1000000.0;
+        if (src->recoverms > src->recovermax) {
+            src->recovermax = src->recoverms;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief a connection was lost or could not be established
+ *        (forwarded LWS_CALLBACK_CLOSED / CLIENT_CONNECTION_ERROR)
+ *        queued frames and the batch frame being built are dropped,
+ *        the owner resyncs after reconnect()
+ * @param context   context that owns the connection
+ * @param wsi       connection
+ */
+void WebsocketIF::closed(libwebsocket_context * context, libwebsocket * wsi)
+{
+    if (wsi == NULL) {
+        /* not bound to a connection, a hung attempt is retried by the
+         * attempt timeout */
+        return;
+    }
+    WebsocketIF *src = find(context, wsi);
+    if (src == NULL) {
+        return;
+    }
+    if (src->isConnected()) {
+        src->ndisconnect++;
+        clock_gettime(CLOCK_MONOTONIC, &src->downtime);
+    }
+    __atomic_store_n(&src->connected, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&src->sockfd, -1, __ATOMIC_RELEASE);
+    src->websocket = NULL;
+    pthread_mutex_lock(&src->sendqlock);
+    src->ndrop += src->sendq.size();
+    src->sendq.clear();
+    pthread_mutex_unlock(&src->sendqlock);
+    /* the service thread leaves the batch to the caller, flush() of a
+     * closed connection drops it */
+    if (src->eventloop != NULL) {
+        src->batchcount = 0;
+        src->batchlen = 0;
+    }
+}
+
+/**
+ * @brief open a new connection after closed()
+ *        without an event loop the service thread opens it
+ * @return true:connecting(established() follows) false:failure, retry
+ */
+bool WebsocketIF::reconnect()
+{
+    if (!isready || isConnected() || protoname == NULL) {
+        return false;
+    }
+    if (eventloop == NULL) {
+        request(REQ_RECONNECT);
+        return true;
+    }
+    return attempt();
+}
+
+/**
+ * @brief open a new connection now, on the thread servicing the context
+ *        an attempt still in progress is left to finish or fail until
+ *        the attempt timeout has passed
+ * @return true:connecting false:failure
+ */
+bool WebsocketIF::attempt()
+{
+    if (isConnected()) {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (websocket != NULL) {
+        long ms = (long) (now.tv_sec - attempttime.tv_sec) * 1000 +
+            (now.tv_nsec - attempttime.tv_nsec) / 1000000;
+        if (ms < attemptms) {
+            return false;
+        }
+        /* handshake hung, a late established() is refused */
+        std::cerr << "Connection attempt timed out(" << connport << ")."
+            << std::endl;
+        websocket = NULL;
+    }
+    attempttime = now;
+    websocket = libwebsocket_client_connect(context, "127.0.0.1", connport,
+                                            0, "/", "localhost", "websocket",
+                                            protoname, -1);
+    return (websocket != NULL);
+}
+
+/**
+ * @brief ask the thread servicing the context for a libwebsockets call
+ * @param req   REQ_*
+ */
+void WebsocketIF::request(unsigned int req)
+{
+    if (eventloop != NULL) {
+        serve(req);
+        return;
+    }
+    __atomic_or_fetch(&pending, req, __ATOMIC_ACQ_REL);
+    transport->wakeup();
+}
+
+/**
+ * @brief make the requested libwebsockets calls(servicing thread)
+ * @param req   REQ_*
+ */
+void WebsocketIF::serve(unsigned int req)
+{
+    if (req & REQ_RECONNECT) {
+        attempt();
+    }
+    if ((req & REQ_WRITABLE) && isConnected() && (websocket != NULL)) {
+        libwebsocket_callback_on_writable(context, websocket);
+    }
+}
+
+/**
+ * @brief serve the pending requests of the connections of a context
+ *        (service thread, woken by WebsocketTransport::wakeup())
+ * @param context   context
+ */
+void WebsocketIF::serveRequests(libwebsocket_context * context)
+{
+    for (size_t i = 0; i < extpollInstances.size(); i++) {
+        WebsocketIF *p = extpollInstances[i];
+        if (p->context != context) {
+            continue;
+        }
+        unsigned int req = __atomic_exchange_n(&p->pending, 0,
+                                               __ATOMIC_ACQ_REL);
+        if (req != 0) {
+            p->serve(req);
+        }
+    }
+}
+
+/**
+ * @brief time a connection attempt may take before reconnect() gives it
+ *        up and opens a new one
+ * @param msec  [ms]
+ */
+void WebsocketIF::setAttemptTimeout(int msec)
+{
+    attemptms = msec;
+}
+
+/**
+ * @brief instance owning a connection
+ * @param context   context of the connection
+ * @param wsi       connection
+ * @return instance, NULL if not found or wsi is NULL
+ */
+WebsocketIF *WebsocketIF::find(libwebsocket_context * context,
+                               libwebsocket * wsi)
+{
+    if (wsi == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < extpollInstances.size(); i++) {
+        WebsocketIF *p = extpollInstances[i];
+        if ((p->context == context) && (p->websocket == wsi)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief established and not closed since
+ */
+bool WebsocketIF::isConnected() const
+{
+    return __atomic_load_n(&connected, __ATOMIC_ACQUIRE);
+}
+
+unsigned long WebsocketIF::connectCount() const
+{
+    return nconnect;
+}
+
+unsigned long WebsocketIF::disconnectCount() const
+{
+    return ndisconnect;
+}
+
+/**
+ * @brief time from the last loss to the connection established again
+ * @return [ms], 0 if never lost
+ */
+double WebsocketIF::lastRecoverTime() const
+{
+    return recoverms;
+}
+
+/**
+ * @brief longest time from a loss to the connection established again
+ * @return [ms]
+ */
+double WebsocketIF::maxRecoverTime() const
+{
+    return recovermax;
+}
+
+/**
+ * @brief time from start() to the first established connection
+ * @return [ms], 0 if not connected yet
+ */
+double WebsocketIF::firstConnectTime() const
+{
+    return firstms;
+}
+
+/**
+ * @brief frames in the send queue
+ */
+int WebsocketIF::sendqDepth() const
+{
+    pthread_mutex_lock(&sendqlock);
+    int n = (int) sendq.size();
+    pthread_mutex_unlock(&sendqlock);
+    return n;
+}
+
+/**
+ * @brief largest number of frames in the send queue
+ */
+int WebsocketIF::sendqMaxDepth() const
+{
+    return sendqmax;
+}
+
+/**
+ * @brief queued frames replaced by a newer frame of the same key
+ */
+unsigned long WebsocketIF::coalesceCount() const
+{
+    return ncoalesce;
+}
+
+/**
+ * @brief frames dropped because the queue was full or the write failed
+ */
+unsigned long WebsocketIF::dropCount() const
+{
+    return ndrop;
+}
+
+unsigned long WebsocketIF::sendCount() const
+{
+    return nsend;
+}
+
+unsigned long WebsocketIF::copyCount() const
+{
+    return ncopy;
+}
+
+unsigned long WebsocketIF::allocCount() const
+{
+    return nalloc;
+}
+
+/**
+ * @brief bytes written but not sent by the kernel yet
+ * @return bytes in the socket send queue, -1 if not connected
+ */
+int WebsocketIF::outq() const
+{
+    int fd = __atomic_load_n(&sockfd, __ATOMIC_ACQUIRE);
+    if (!isready || fd < 0) {
+        return -1;
+    }
+    int n = 0;
+    if (ioctl(fd, SIOCOUTQ, &n) < 0) {
+        return -1;
+    }
+    return n;
 }
 
 bool WebsocketIF::recv(char *msg, bool fblocking)
@@ -164,11 +848,18 @@ bool WebsocketIF::recv(char *msg, bool fblocking)
     }
 
     if (fblocking) {
-        if (queue->empty()) {
-            if (pthread_cond_wait(cond, mutex) != 0) {
-                std::cerr << "Failed to wait signal" << std::endl;
+        if (eventloop != NULL) {
+            /* nobody else services the socket, pump the loop here */
+            while (queue->empty()) {
+                if (0 > eventloop->Dispatch(100)) {
+                    return false;
+                }
             }
         }
+        else if (!queue->wait()) {
+            std::cerr << "Failed to wait queue" << std::endl;
+            return false;
+        }
         queue->front(msg);
         queue->pop();
     }
@@ -184,48 +875,288 @@ bool WebsocketIF::recv(char *msg, bool fblocking)
     return true;
 }
 
-bool WebsocketIF::poll()
+/**
+ * @brief external poll request from libwebsockets
+ * @param context   context that owns the socket
+ * @param reason    LWS_CALLBACK_*_POLL_FD
+ * @param user      socket
+ * @param len       events to add/set/clear
+ * @return true:handled false:not an external poll context
+ */
+bool WebsocketIF::pollfd(libwebsocket_context * context,
+                         enum libwebsocket_callback_reasons reason,
+                         void *user, size_t len)
 {
-    if (!isready) {
-        return isready;
+    return WebsocketTransport::pollfd(context, reason, user, len);
+}
+
+bool WebsocketIF::init(int port, char *interface,
+                       libwebsocket_protocols * protocols,
+                       pthread_mutex_t * mtx,
+                       pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue)
+{
+    transport = new WebsocketTransport();
+    owntransport = true;
+    if (!transport->open(interface, protocols, eventloop)) {
+        return false;
+    }
+    context = transport->getContext();
+    if (!connect(port, protocols[0].name)) {
+        return false;
+    }
+    if ((eventloop == NULL) && (!transport->run())) {
+        return false;
     }
+    return true;
+}
 
-    int ret = 0;
-    while (true) {
-        ret = libwebsocket_service(context, 100);
+/**
+ * @brief open the connection of a protocol on the context
+ * @param port      server port
+ * @param protocol  protocol name
+ * @return true:success false:failure
+ */
+bool WebsocketIF::connect(int port, const char *protocol)
+{
+    extpollInstances.push_back(this);
+    connport = port;
+    protoname = protocol;
+    clock_gettime(CLOCK_MONOTONIC, &starttime);
+    attempttime = starttime;
+    websocket = libwebsocket_client_connect(context, "127.0.0.1", port,
+                                            0, "/", "localhost", "websocket",
+                                            protocol, -1);
+    if (eventloop != NULL) {
+        /* not listening yet: the owner retries by reconnect() */
+        if (websocket == NULL) {
+            std::cerr << "Failed to connect server(" << port << ")."
+                << std::endl;
+        }
+        return true;
+    }
+    if (websocket == NULL) {
+        std::cerr << "Failed to connect server." << std::endl;
+        return false;
     }
+    return true;
 }
 
-void *WebsocketIF::loop(void *arg)
+WebsocketTransport::WebsocketTransport()
+:  context(NULL), eventloop(NULL), servloop(NULL), wakefd(-1), threadid(0)
 {
-    WebsocketIF *src = reinterpret_cast < WebsocketIF * >(arg);
-    return (void *) src->poll();
 }
 
-bool WebsocketIF::init(int port, char *interface,
-                       libwebsocket_protocols * protocols,
-                       pthread_mutex_t * mtx,
-                       pthread_cond_t * cnd, WebsocketRecvQueue * recvqueue)
+WebsocketTransport::~WebsocketTransport()
+{
+    close();
+}
+
+/**
+ * @brief create the context
+ * @param interface network interface
+ * @param protocols protocol array, the connections pick theirs by name
+ * @param evloop    event loop servicing the sockets, NULL: run() thread
+ * @return true:success false:failure
+ */
+bool WebsocketTransport::open(char *interface,
+                              libwebsocket_protocols * protocols,
+                              CEventLoop * evloop)
 {
+    if (context != NULL) {
+        return true;
+    }
+    eventloop = evloop;
+    servloop = evloop;
+    if (servloop == NULL) {
+        /* the service thread dispatches a loop of its own */
+        if (!ownloop.Open()) {
+            return false;
+        }
+        wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ((wakefd < 0) ||
+            (!ownloop.Add(wakefd, POLLIN, WebsocketTransport::wake,
+                          (void *) this))) {
+            std::cerr << "Failed to create eventfd." << std::endl;
+            close();
+            return false;
+        }
+        servloop = &ownloop;
+    }
+    extpollPending = this;
     context = libwebsocket_create_context(CONTEXT_PORT_NO_LISTEN,
                                           interface, protocols,
                                           libwebsocket_internal_extensions,
                                           NULL, NULL, -1, -1, 0);
+    extpollPending = NULL;
     if (context == NULL) {
         std::cerr << "Failed to create context." << std::endl;
+        close();
         return false;
     }
-    websocket = libwebsocket_client_connect(context, "127.0.0.1", port,
-                                            0, "/", "localhost", "websocket",
-                                            protocols[0].name, -1);
-    if (websocket == NULL) {
-        std::cerr << "Failed to connect server." << std::endl;
+    extpollTransports.push_back(this);
+    return true;
+}
+
+/**
+ * @brief start the service thread(no event loop)
+ * @return true:success false:failure
+ */
+bool WebsocketTransport::run()
+{
+    if ((context == NULL) || (eventloop != NULL)) {
         return false;
     }
-    if (pthread_create(&threadid, NULL, WebsocketIF::loop,
+    if (threadid != 0) {
+        return true;
+    }
+    if (pthread_create(&threadid, NULL, WebsocketTransport::loop,
                        (void *) this) != 0) {
         std::cerr << "Failed to create thread." << std::endl;
+        threadid = 0;
         return false;
     }
     return true;
 }
+
+/**
+ * @brief stop the service thread and destroy the context, all
+ *        connections on it are closed
+ */
+void WebsocketTransport::close()
+{
+    int ret;
+    if (threadid != 0) {
+        ret = pthread_cancel(threadid);
+        if (ret != 0) {
+            std::cerr << "Failed to pthread_cancel" << std::endl;
+        }
+        ret = pthread_join(threadid, NULL);
+        if (ret != 0) {
+            std::cerr << "Failed to pthread_join" << std::endl;
+        }
+        threadid = 0;
+    }
+    if (context != NULL) {
+        libwebsocket_context_destroy(context);
+        context = NULL;
+    }
+    for (size_t i = 0; i < extpollTransports.size(); i++) {
+        if (extpollTransports[i] == this) {
+            extpollTransports.erase(extpollTransports.begin() + i);
+            break;
+        }
+    }
+    ownloop.Close();
+    if (wakefd >= 0) {
+        ::close(wakefd);
+        wakefd = -1;
+    }
+    servloop = NULL;
+}
+
+/**
+ * @brief wake the service thread to serve the pending requests of the
+ *        connections, no-op with an event loop
+ */
+void WebsocketTransport::wakeup()
+{
+    if (wakefd < 0) {
+        return;
+    }
+    uint64_t one = 1;
+    if (::write(wakefd, &one, sizeof(one)) < 0) {
+        /* counter saturated, the thread is woken anyway */
+    }
+}
+
+/**
+ * @brief wakeup() event(service thread)
+ */
+void WebsocketTransport::wake(int fd, unsigned int /*events*/, void *arg)
+{
+    WebsocketTransport *src = reinterpret_cast < WebsocketTransport * >(arg);
+    uint64_t cnt;
+    if (::read(fd, &cnt, sizeof(cnt)) < 0) {
+        /* EAGAIN: already consumed */
+    }
+    WebsocketIF::serveRequests(src->context);
+}
+
+libwebsocket_context *WebsocketTransport::getContext() const
+{
+    return context;
+}
+
+CEventLoop *WebsocketTransport::getEventLoop() const
+{
+    return eventloop;
+}
+
+/**
+ * @brief external poll request from libwebsockets
+ * @param context   context that owns the socket
+ * @param reason    LWS_CALLBACK_*_POLL_FD
+ * @param user      socket
+ * @param len       events to add/set/clear
+ * @return true:handled false:not an external poll context
+ */
+bool WebsocketTransport::pollfd(libwebsocket_context * context,
+                                enum libwebsocket_callback_reasons reason,
+                                void *user, size_t len)
+{
+    WebsocketTransport *src = extpollPending;
+    for (size_t i = 0; i < extpollTransports.size(); i++) {
+        if (extpollTransports[i]->context == context) {
+            src = extpollTransports[i];
+            break;
+        }
+    }
+    if ((src == NULL) || (src->servloop == NULL)) {
+        return false;
+    }
+
+    CEventLoop *evloop = src->servloop;
+    int fd = (int) (long) user;
+    switch (reason) {
+    case LWS_CALLBACK_ADD_POLL_FD:
+        return evloop->Add(fd, (unsigned int) len,
+                           WebsocketTransport::service, (void *) src);
+    case LWS_CALLBACK_DEL_POLL_FD:
+        return evloop->Remove(fd);
+    case LWS_CALLBACK_SET_MODE_POLL_FD:
+        return evloop->Modify(fd, evloop->GetEvents(fd) | (unsigned int) len);
+    case LWS_CALLBACK_CLEAR_MODE_POLL_FD:
+        return evloop->Modify(fd, evloop->GetEvents(fd) & ~(unsigned int) len);
+    default:
+        break;
+    }
+    return false;
+}
+
+/**
+ * @brief service a socket which became ready in the event loop
+ */
+void WebsocketTransport::service(int fd, unsigned int events, void *arg)
+{
+    WebsocketTransport *src = reinterpret_cast < WebsocketTransport * >(arg);
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = (short) src->servloop->GetEvents(fd);
+    pfd.revents = (short) events;
+    libwebsocket_service_fd(src->context, &pfd);
+}
+
+/**
+ * @brief service thread, one for all connections of the context,
+ *        the only thread calling libwebsockets
+ */
+void *WebsocketTransport::loop(void *arg)
+{
+    WebsocketTransport *src = reinterpret_cast < WebsocketTransport * >(arg);
+    while (true) {
+        if (0 > src->servloop->Dispatch(100)) {
+            break;
+        }
+    }
+    return NULL;
+}
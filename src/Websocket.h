@@ -13,10 +13,19 @@
 #ifndef _ICO_VIC_WEBSOCKET_H_
 #define _ICO_VIC_WEBSOCKET_H_
 
+#include <time.h>
 #include <sys/time.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
 
 #include <libwebsockets.h>
 
+#include "CEventLoop.h"
+
 const int MsgQueueMaxMsgSize = 128;
 
 struct KeyEventOptMsg_t
@@ -42,6 +51,201 @@ struct KeyDataMsg_t
     } data;
 };
 
+/**
+ * compact record, see "Compact format" below
+ */
+struct KeyDataCompact_t
+{
+    char magic[2];
+    uint16_t id;
+    uint32_t usec;
+    char status[];
+};
+
+/**
+ * Batched frame (optional, one frame per run loop tick)
+ *
+ *   offset  size  field
+ *   0       4     magic "\0VB1"  (a KeyDataMsg_t never starts with '\0')
+ *   4       4     number of records
+ *   8       ...   records
+ *
+ * record:
+ *   0       4     size of the message that follows
+ *   4       4     reserved(0)
+ *   8       size  message, same layout as a single message
+ *                 (KeyDataMsg_t, KeyDataCompact_t or fleet tagged)
+ *   then padding up to the next multiple of 8 (relative to frame start)
+ *
+ * Decoder for the AMB side:
+ *
+ *   if (KeyDataIsBatch(frame, len)) {
+ *       int pos = 0;
+ *       const KeyDataMsg_t *msg;
+ *       int size;
+ *       while (KeyDataBatchNext(frame, len, &pos, &msg, &size)) {
+ *           ... handle msg exactly like a single message of size bytes ...
+ *       }
+ *   }
+ *   else {
+ *       ... frame is one KeyDataMsg_t ...
+ *   }
+ */
+#define KEYDATA_BATCH_MAGIC     "\0VB1"
+#define KEYDATA_BATCH_HDRSIZE   8
+#define KEYDATA_BATCH_RECHDRSIZE 8
+#define KEYDATA_BATCH_ALIGN(n)  (((n) + 7) & ~7)
+
+inline bool KeyDataIsBatch(const char *frame, int len)
+{
+    return (len >= KEYDATA_BATCH_HDRSIZE &&
+            memcmp(frame, KEYDATA_BATCH_MAGIC, 4) == 0);
+}
+
+inline bool KeyDataBatchNext(const char *frame, int len, int *pos,
+                             const KeyDataMsg_t **msg, int *size)
+{
+    int off = (*pos == 0) ? KEYDATA_BATCH_HDRSIZE : *pos;
+    if (off + KEYDATA_BATCH_RECHDRSIZE > len) {
+        return false;
+    }
+    uint32_t recsize;
+    memcpy(&recsize, &frame[off], sizeof(recsize));
+    if (recsize < sizeof(KeyDataCompact_t) ||
+        (int) recsize > len - off - KEYDATA_BATCH_RECHDRSIZE) {
+        return false;
+    }
+    *msg = reinterpret_cast < const KeyDataMsg_t * >
+        (&frame[off + KEYDATA_BATCH_RECHDRSIZE]);
+    *size = (int) recsize;
+    *pos = KEYDATA_BATCH_ALIGN(off + KEYDATA_BATCH_RECHDRSIZE + recsize);
+    return true;
+}
+
+/**
+ * Compact format (optional, negotiated per connection)
+ *
+ * 1. carsim sends a name table frame when the connection is established
+ *
+ *   offset  size  field
+ *   0       4     magic "\0VT1"
+ *   4       4     number of entries
+ *   8       8     base time, sec (int64, gettimeofday)
+ *   16      8     base time, usec (int64)
+ *   24      ...   entries: id(uint16), length(uint8), name(length bytes)
+ *
+ * 2. AMB answers with the 4 byte frame "\0VA1" if it can decode the
+ *    compact format. Until then carsim keeps sending KeyDataMsg_t.
+ *
+ * 3. a vehicle info whose name is in the table is then sent as
+ *
+ *   0       2     magic "\0C"
+ *   2       2     id
+ *   4       4     micro sec since base time (CLOCK_MONOTONIC)
+ *   8       ...   status, same bytes as KeyDataMsg_t::data.status
+ *
+ *   If the time offset would overflow, a new table with a new base time
+ *   is sent first. Names not in the table are still sent as KeyDataMsg_t.
+ *   A compact message can also be a record of a batched frame.
+ *
+ * Decoder for the AMB side:
+ *
+ *   if (KeyDataIsTable(frame, len)) {
+ *       int pos = 0;
+ *       int id, namelen;
+ *       const char *name;
+ *       while (KeyDataTableNext(frame, len, &pos, &id, &name, &namelen)) {
+ *           ... remember id -> name ...
+ *       }
+ *       ... remember base time, send KEYDATA_ACK_MAGIC back ...
+ *   }
+ *   else if (KeyDataIsCompact(msg, size)) {
+ *       const KeyDataCompact_t *c = (const KeyDataCompact_t *) msg;
+ *       ... name of c->id, base time + c->usec,
+ *           size - sizeof(KeyDataCompact_t) bytes of c->status ...
+ *   }
+ */
+#define KEYDATA_TABLE_MAGIC     "\0VT1"
+#define KEYDATA_ACK_MAGIC       "\0VA1"
+#define KEYDATA_COMPACT_MAGIC   "\0C"
+#define KEYDATA_TABLE_HDRSIZE   24
+
+inline bool KeyDataIsTable(const char *frame, int len)
+{
+    return (len >= KEYDATA_TABLE_HDRSIZE &&
+            memcmp(frame, KEYDATA_TABLE_MAGIC, 4) == 0);
+}
+
+inline bool KeyDataIsAck(const char *frame, int len)
+{
+    return (len >= 4 && memcmp(frame, KEYDATA_ACK_MAGIC, 4) == 0);
+}
+
+inline bool KeyDataIsCompact(const char *msg, int len)
+{
+    return (len >= (int) sizeof(KeyDataCompact_t) &&
+            memcmp(msg, KEYDATA_COMPACT_MAGIC, 2) == 0);
+}
+
+/**
+ * Fleet tagged message (fleet simulation mode, carsim -F)
+ *
+ *   0       2     magic "\0F"
+ *   2       2     reserved(0)
+ *   4       4     vehicle number, 0 .. number of vehicles - 1
+ *   8       ...   KeyDataMsg_t or KeyDataCompact_t of that vehicle
+ *
+ * Decoder for the AMB side:
+ *
+ *   if (KeyDataIsFleet(msg, size)) {
+ *       const KeyDataFleetHdr_t *f = (const KeyDataFleetHdr_t *) msg;
+ *       ... f->vehicle ...
+ *       msg += sizeof(KeyDataFleetHdr_t);
+ *       size -= sizeof(KeyDataFleetHdr_t);
+ *   }
+ */
+#define KEYDATA_FLEET_MAGIC     "\0F"
+
+struct KeyDataFleetHdr_t
+{
+    char magic[2];
+    uint16_t reserved;
+    uint32_t vehicle;
+};
+
+inline bool KeyDataIsFleet(const char *msg, int len)
+{
+    return (len >= (int) sizeof(KeyDataFleetHdr_t) &&
+            memcmp(msg, KEYDATA_FLEET_MAGIC, 2) == 0);
+}
+
+inline bool KeyDataTableNext(const char *frame, int len, int *pos, int *id,
+                             const char **name, int *namelen)
+{
+    int off = (*pos == 0) ? KEYDATA_TABLE_HDRSIZE : *pos;
+    if (off + 3 > len) {
+        return false;
+    }
+    uint16_t tid;
+    memcpy(&tid, &frame[off], sizeof(tid));
+    int nlen = (unsigned char) frame[off + 2];
+    if (off + 3 + nlen > len) {
+        return false;
+    }
+    *id = tid;
+    *name = &frame[off + 3];
+    *namelen = nlen;
+    *pos = off + 3 + nlen;
+    return true;
+}
+
+/**
+ * Single producer(libwebsocket callback) / single consumer(recv) queue.
+ * Capacity is rounded up to a power of two, push/pop are O(1) and
+ * lock-free. The consumer can block in wait(), the producer signals
+ * the eventfd only while a consumer is blocked there, so a push costs
+ * no syscall when nobody waits (event loop mode).
+ */
 class WebsocketRecvQueue
 {
   public:
@@ -53,47 +257,222 @@ class WebsocketRecvQueue
     bool empty() const;
     void pop();
     int size() const;
+    bool wait();
+    int getfd() const;
+    unsigned long overflowCount() const;
+    unsigned long oversizeCount() const;
 
     static const int maxdatasize = sizeof(KeyDataMsg_t) + MsgQueueMaxMsgSize;
   private:
-    void init();
+    void init(int queuesize);
 
-    int maxqueuesize;
-    int msize;
+    unsigned int capacity;
+    unsigned int mask;
+    unsigned int head;          // written by consumer only
+    unsigned int tail;          // written by producer only
+    bool waiting;               // consumer blocked in wait()
     char (*mdata)[maxdatasize];
     int *mdatasize;
+    int efd;
+    unsigned long overflow;     // dropped, queue full
+    unsigned long oversize;     // dropped, larger than maxdatasize
 };
 
+/**
+ * One libwebsocket context serviced by one event loop or thread, shared
+ * by the connections of all protocols in its protocol array.
+ * If an event loop is given to open(), the websocket sockets are
+ * registered to it (libwebsockets external poll) and no service thread
+ * is created. The protocol callbacks have to forward
+ * LWS_CALLBACK_{ADD,DEL,SET_MODE,CLEAR_MODE}_POLL_FD to
+ * WebsocketIF::pollfd(). Without an event loop, run() starts a
+ * service thread dispatching a private event loop, after all
+ * connections are started. libwebsockets is not thread safe, other
+ * threads reach it only through wakeup(), the thread then serves the
+ * requests of the connections.
+ */
+class WebsocketTransport
+{
+  public:
+    WebsocketTransport();
+        ~WebsocketTransport();
+    bool open(char *interface, libwebsocket_protocols *protocols,
+              CEventLoop *evloop = NULL);
+    bool run();
+    void close();
+    void wakeup();
+    libwebsocket_context *getContext() const;
+    CEventLoop *getEventLoop() const;
+    static bool pollfd(libwebsocket_context *context,
+                       enum libwebsocket_callback_reasons reason,
+                       void *user, size_t len);
+  private:
+    static void service(int fd, unsigned int events, void *arg);
+    static void wake(int fd, unsigned int events, void *arg);
+    static void *loop(void *arg);
+
+    libwebsocket_context *context;
+    CEventLoop *eventloop;      // given to open(), NULL: service thread
+    CEventLoop *servloop;       // loop servicing the sockets
+    CEventLoop ownloop;         // loop of the service thread
+    int wakefd;                 // eventfd, wakes the service thread
+    pthread_t threadid;
+};
+
+/**
+ * A connection of one protocol. start() with a transport connects on
+ * the shared context, the other forms create a context of their own.
+ */
+/**
+ * Sending without copy:
+ *   char *p = ws.reserve(size);   // &sendbuf[LWS_SEND_BUFFER_PRE_PADDING]
+ *   ... build the message in p ...
+ *   ws.commit(size);
+ * send() is kept for callers which already have the message in memory,
+ * costs one copy and is never batched.
+ * In batch mode commit() only closes the record, flush() writes all
+ * records committed since the previous flush() as one batched frame.
+ *
+ * Backpressure:
+ *   a frame is written at once only if nothing is queued and the socket
+ *   is writable, otherwise it is copied to the send queue, which is
+ *   drained from LWS_CALLBACK_CLIENT_WRITEABLE (the protocol callback
+ *   has to forward it to writeable()). A queued frame committed with a
+ *   key is replaced by the next frame of the same key (latest wins).
+ *   When the queue is full, new frames are dropped, the caller never
+ *   blocks. Without an event loop every frame goes through the queue,
+ *   so only the service thread writes to the socket, the caller wakes
+ *   it to request the writable callback.
+ *
+ * Reconnect:
+ *   the protocol callback forwards LWS_CALLBACK_CLIENT_ESTABLISHED to
+ *   established() and LWS_CALLBACK_CLOSED /
+ *   LWS_CALLBACK_CLIENT_CONNECTION_ERROR to closed(). While closed,
+ *   nothing is written or queued, the owner calls reconnect() to open
+ *   a new connection on the same context. An attempt not established
+ *   within setAttemptTimeout() is abandoned by the next reconnect(),
+ *   the protocol callback returns -1 when established() refuses a
+ *   connection so libwebsockets closes it.
+ */
 class WebsocketIF
 {
+    friend class WebsocketTransport;
   public:
     WebsocketIF();
     WebsocketIF(int port, char *interface, libwebsocket_protocols *protocol,
                 pthread_mutex_t *mtx, pthread_cond_t *cnd,
-                WebsocketRecvQueue *recvqueue);
+                WebsocketRecvQueue *recvqueue, CEventLoop *evloop = NULL);
         ~WebsocketIF();
     bool start(int port, char *interface, libwebsocket_protocols *protocol,
+               pthread_mutex_t *mtx, pthread_cond_t *cnd,
+               WebsocketRecvQueue *recvqueue, CEventLoop *evloop = NULL);
+    bool start(WebsocketTransport *transport, int port, const char *protocol,
                pthread_mutex_t *mtx, pthread_cond_t *cnd,
                WebsocketRecvQueue *recvqueue);
     bool send(char *msg, int size);
+    char *reserve(int size);
+    bool commit(int size, int key = -1);
+    void setBatch(bool enable);
+    bool flush();
+    unsigned long sendCount() const;
+    unsigned long copyCount() const;
+    unsigned long allocCount() const;
+    int outq() const;
+    bool isConnected() const;
+    bool reconnect();
+    void setAttemptTimeout(int msec);
+    unsigned long connectCount() const;
+    unsigned long disconnectCount() const;
+    double lastRecoverTime() const;
+    double maxRecoverTime() const;
+    double firstConnectTime() const;
+    int sendqDepth() const;
+    int sendqMaxDepth() const;
+    unsigned long coalesceCount() const;
+    unsigned long dropCount() const;
     bool recv(char *msg, bool fbolcking);
-    bool poll();
-    static void *loop(void *arg);
+    static bool pollfd(libwebsocket_context *context,
+                       enum libwebsocket_callback_reasons reason,
+                       void *user, size_t len);
+    static void writeable(libwebsocket_context *context, libwebsocket *wsi);
+    static bool established(libwebsocket_context *context,
+                            libwebsocket *wsi);
+    static void closed(libwebsocket_context *context, libwebsocket *wsi);
+    static const int sendqmaxsize = 256;        // frames
+    static const int attemptdefault = 5000;     // [ms] see reconnect()
   private:
+    /**
+     * frame waiting in the send queue
+     */
+    struct SendFrame
+    {
+        int key;                // -1: never coalesced
+        int len;
+        std::vector<char> buf;  // pre-padding + payload + post-padding
+    };
+
     bool init(int port, char *interface,
               libwebsocket_protocols *protocol, pthread_mutex_t *mtx,
               pthread_cond_t *cnd, WebsocketRecvQueue *recvqueue);
+    bool connect(int port, const char *protocol);
+    char *grow(int need);
+    bool write(int len, int key);
+    bool enqueue(int len, int key);
+    bool writable() const;
+    void drain();
+    static WebsocketIF *find(libwebsocket_context *context,
+                             libwebsocket *wsi);
+    bool attempt();
+    void request(unsigned int req);
+    void serve(unsigned int req);
+    static void serveRequests(libwebsocket_context *context);
+
+    /**
+     * requests served by the thread servicing the context
+     */
+    enum
+    {
+        REQ_WRITABLE = 1,       // queued frames, request the writable cb
+        REQ_RECONNECT = 2       // open a new connection
+    };
 
     bool isready;
+    CEventLoop *eventloop;
+    WebsocketTransport *transport;
+    bool owntransport;          // transport created by init()
     libwebsocket_context *context;
     libwebsocket *websocket;
-    pthread_t threadid;
     pthread_mutex_t *mutex;
     pthread_cond_t *cond;
-    char sendbuf[LWS_SEND_BUFFER_PRE_PADDING +
-                 WebsocketRecvQueue::maxdatasize +
-                 LWS_SEND_BUFFER_POST_PADDING];
+    char *sendbuf;              // pre-padding + payload + post-padding
+    int sendbufsize;            // payload capacity of sendbuf
+    unsigned long nsend;        // messages written
+    unsigned long ncopy;        // messages copied into sendbuf by send()
+    unsigned long nalloc;       // sendbuf (re)allocations
+    bool batch;                 // batch mode
+    int batchcount;             // records in batch frame
+    int batchlen;               // bytes used in batch frame
+    int batchrec;               // offset of the record being reserved
     WebsocketRecvQueue *queue;
+    std::deque<SendFrame> sendq;
+    mutable pthread_mutex_t sendqlock;  // sendq, service thread mode
+    int sendqmax;               // largest depth of sendq
+    unsigned long ncoalesce;    // queued frames replaced by a newer one
+    unsigned long ndrop;        // frames dropped, queue full or failed
+    int connport;               // server port
+    const char *protoname;      // protocol to connect with
+    bool connected;             // established and not closed(atomic)
+    int sockfd;                 // socket while connected(atomic), -1
+    unsigned int pending;       // REQ_* for the service thread(atomic)
+    unsigned long nconnect;     // connections established
+    unsigned long ndisconnect;  // connections lost
+    struct timespec downtime;   // CLOCK_MONOTONIC of the last loss
+    double recoverms;           // loss to established, last [ms]
+    double recovermax;          // loss to established, longest [ms]
+    struct timespec starttime;  // CLOCK_MONOTONIC of the first connect
+    struct timespec attempttime;        // CLOCK_MONOTONIC of the attempt
+    double firstms;             // start to first established [ms]
+    int attemptms;              // attempt abandoned after [ms]
 };
 
 #endif //#ifndef _ICO_VIC_WEBSOCKET_H_